@@ -0,0 +1,122 @@
+/*
+ * Loopback benchmark of the Modbus UDP slave transport.
+ *
+ * A client sends bursts of FC03 requests to a slave on 127.0.0.1 and waits
+ * for all replies. The slave side runs once with batched recvmmsg/sendmmsg
+ * (modbus_udp_poll) and once one datagram at a time (modbus_udp_poll_one),
+ * and the system calls per request and the request rate are compared. The
+ * client itself always uses sendmmsg/recvmmsg, so that its cost does not
+ * hide the difference on the slave side.
+ *
+ * Usage: modbus_udp_bench [rounds]
+ */
+#define _GNU_SOURCE
+
+#include "modbus_udp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BURST MODBUS_UDP_BATCH
+
+static uint8_t rx[MODBUS_UDP_BATCH * MODBUS_UDP_ADU_SIZE];
+static modbus_udp_t udp;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, int batched, int server, int client, modbus_slave_t *slave, long rounds) {
+    static uint8_t req[BURST][12], rsp[BURST][MODBUS_UDP_ADU_SIZE];
+    struct mmsghdr req_msgs[BURST], rsp_msgs[BURST];
+    struct iovec req_iov[BURST], rsp_iov[BURST];
+    long round;
+    int i, handled, rc;
+    double start, elapsed;
+    uint32_t requests;
+
+    for (i = 0; i < BURST; i++) {
+        static const uint8_t fc03[12] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x08};
+        memcpy(req[i], fc03, sizeof(fc03));
+        req[i][1] = (uint8_t) i;
+        req_iov[i].iov_base = req[i];
+        req_iov[i].iov_len = sizeof(req[i]);
+        rsp_iov[i].iov_base = rsp[i];
+        rsp_iov[i].iov_len = sizeof(rsp[i]);
+        memset(&req_msgs[i], 0, sizeof(req_msgs[i]));
+        memset(&rsp_msgs[i], 0, sizeof(rsp_msgs[i]));
+        req_msgs[i].msg_hdr.msg_iov = &req_iov[i];
+        req_msgs[i].msg_hdr.msg_iovlen = 1;
+        rsp_msgs[i].msg_hdr.msg_iov = &rsp_iov[i];
+        rsp_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    modbus_udp_init(&udp, server, slave, rx, sizeof(rx));
+    start = now_s();
+    for (round = 0; round < rounds; round++) {
+        sendmmsg(client, req_msgs, BURST, 0);
+        for (handled = 0; handled < BURST; handled += rc) {
+            rc = batched ? modbus_udp_poll(&udp) : modbus_udp_poll_one(&udp);
+            if (rc < 0) {
+                perror("poll");
+                exit(1);
+            }
+        }
+        for (i = 0; i < BURST; i += rc) {
+            rc = recvmmsg(client, &rsp_msgs[i], BURST - i, MSG_WAITFORONE, NULL);
+            if (rc <= 0) {
+                perror("recvmmsg");
+                exit(1);
+            }
+        }
+    }
+    elapsed = now_s() - start;
+    requests = udp.requests;
+    printf("%-8s requests %lu, recv calls %lu, send calls %lu, syscalls/request %.3f, %.0f requests/s\n",
+           name, (unsigned long) requests, (unsigned long) udp.recv_calls, (unsigned long) udp.send_calls,
+           (double) (udp.recv_calls + udp.send_calls) / requests, requests / elapsed);
+}
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 20000;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int server, client, size = 1 << 20;
+    static uint8_t data[16];
+    modbus_slave_t slave;
+    modbus_register_t reg;
+
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    modbus_register_init(&reg);
+    reg.index = 1;
+    reg.size = 8;
+    reg.data = data;
+    modbus_slave_add_register(&slave, &reg);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server = socket(AF_INET, SOCK_DGRAM, 0);
+    client = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(server, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(client, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (bind(server, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        getsockname(server, (struct sockaddr *) &addr, &addr_len) != 0 ||
+        connect(client, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        perror("socket");
+        return 1;
+    }
+
+    run("single", 0, server, client, &slave, rounds);
+    run("batched", 1, server, client, &slave, rounds);
+
+    close(client);
+    close(server);
+    return 0;
+}
@@ -14,6 +14,19 @@ extern "C" {
 #define MODBUS_READ_INPUT_REGISTERS   0x04
 #define MODBUS_WRITE_MULTI_REGISTERS  0x10
 
+/**
+ * @brief Calculate the Modbus CRC16 checksum for a given buffer.
+ *
+ * This function calculates the Modbus CRC16 checksum for the specified buffer.
+ * It uses the CCITT CRC16 lookup table for efficient computation. The result
+ * is appended to an RTU frame as is, with memcpy.
+ *
+ * @param buf The input buffer.
+ * @param len The length of the buffer.
+ * @return The calculated CRC16 checksum.
+ */
+uint16_t modbus_crc16(const uint8_t *buf, int len);
+
 /**
  * @brief Converts a Modbus register format buffer to uint16 format.
  *
@@ -68,6 +81,18 @@ typedef struct modbus_register_s modbus_register_t;
  */
 typedef int (*modbus_register_rw_cb)(modbus_register_t *reg, const uint8_t *buf);
 
+/**
+ * @brief Modbus register range access callback prototype.
+ * @param reg Pointer to the Modbus register.
+ * @param offset Offset of the first accessed register inside the node, in half words.
+ * @param quan Quantity of accessed registers.
+ * @param buf Pointer to the registers in Modbus byte order, the reply on read
+ *        and the written values on write.
+ * @return Return value indicating the result of the callback.
+ *         A negative value indicates an internal error.
+ */
+typedef int (*modbus_register_range_cb)(modbus_register_t *reg, uint16_t offset, uint16_t quan, uint8_t *buf);
+
 /**
  * @brief Modbus register chain list node.
  */
@@ -77,6 +102,8 @@ struct modbus_register_s {
     uint8_t *data; /**< Data pointer. */
     modbus_register_rw_cb on_read; /**< Read callback. Return a negative value to indicate internal error. */
     modbus_register_rw_cb on_write; /**< Write callback. Return a negative value to indicate internal error. */
+    modbus_register_range_cb load; /**< Optional, replaces the copy out of data and allows partial reads. */
+    modbus_register_range_cb store; /**< Optional, replaces the copy into data and allows partial writes. */
     struct modbus_register_s *next; /**< Pointer to the next register in the chain. */
 };
 
@@ -107,6 +134,28 @@ typedef struct modbus_slave_s modbus_slave_t;
  */
 typedef int (*modbus_slave_rw_cb)(modbus_slave_t *slave, uint8_t *buf, uint16_t len);
 
+/**
+ * @brief Modbus batched write callback function prototype.
+ * @param slave Pointer to the Modbus slave.
+ * @param addr Starting address of the written range, starting from 0.
+ * @param quan Quantity of written registers.
+ * @return Returns a value indicating the result of the callback.
+ *         A negative value indicates an error.
+ */
+typedef int (*modbus_slave_write_batch_cb)(modbus_slave_t *slave, uint16_t addr, uint16_t quan);
+
+/**
+ * @brief Cached FC03 reply of a Modbus slave.
+ */
+typedef struct modbus_cache_entry_s {
+    uint8_t valid; /**< Whether the entry holds a reply. */
+    uint8_t function_code; /**< Function code of the request. */
+    uint16_t addr; /**< Starting address of the request. */
+    uint16_t quan; /**< Register quantity of the request. */
+    uint16_t len; /**< Length of the reply including the CRC. */
+    uint8_t frame[255]; /**< Encoded reply, frame[0] is the unit ID. */
+} modbus_cache_entry_t;
+
 /**
  * @brief Modbus slave structure.
  */
@@ -116,6 +165,14 @@ struct modbus_slave_s {
     uint16_t register_len; /**< Length of the register chan list. */
     modbus_slave_rw_cb on_read; /**< Callback function for slave receive. */
     modbus_slave_rw_cb on_write; /**< Callback function for slave reply. */
+    modbus_slave_write_batch_cb on_write_batch; /**< Callback function once per validated write frame, with the registers actually written. */
+    uint8_t *dirty_map; /**< Optional zero-initialized bitmap, one bit per written register address. */
+    uint16_t dirty_map_size; /**< Size of the dirty bitmap in Bytes. */
+    modbus_cache_entry_t *cache; /**< Optional zero-initialized FC03 reply cache. */
+    uint16_t cache_len; /**< Number of cache entries. */
+#ifdef MODBUS_TRACE
+    struct modbus_trace_s *trace; /**< Optional trace ring buffer, see modbus_trace.h. */
+#endif
 };
 
 /**
@@ -141,6 +198,36 @@ int modbus_slave_add_register(modbus_slave_t *slave, modbus_register_t *reg);
  */
 int modbus_slave_remove_register(modbus_slave_t *slave, modbus_register_t *reg);
 
+/**
+ * @brief Takes the first run of dirty registers out of the dirty bitmap of a Modbus slave.
+ *
+ * Registers written by the master are marked in slave->dirty_map. This function
+ * clears the first contiguous run of marked registers and returns it. It may be
+ * called from another thread than modbus_slave_rtu_handle, so a control loop can
+ * collect the changes once per cycle.
+ *
+ * @param slave Pointer to the Modbus slave.
+ * @param addr Pointer to store the starting address of the run, starting from 0.
+ * @param quan Pointer to store the quantity of registers in the run.
+ * @return Returns 1 if a run was taken, or 0 if no register is dirty.
+ */
+int modbus_slave_consume_dirty(modbus_slave_t *slave, uint16_t *addr, uint16_t *quan);
+
+/**
+ * @brief Drops cached replies covering registers that changed outside of Modbus writes.
+ *
+ * Replies are cached only when slave->cache is set, and never for registers
+ * with an on_read callback. FC10 writes invalidate the cache by themselves;
+ * the application calls this function after updating register data directly.
+ * It must not run concurrently with modbus_slave_rtu_handle.
+ *
+ * @param slave Pointer to the Modbus slave.
+ * @param addr Starting address of the changed range, starting from 0.
+ * @param quan Quantity of changed registers.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_slave_invalidate(modbus_slave_t *slave, uint16_t addr, uint16_t quan);
+
 /**
  * @brief This function is used to handle incoming RTU data for a Modbus slave.
  * @param slave Pointer to the Modbus slave.
@@ -157,6 +244,22 @@ int modbus_slave_remove_register(modbus_slave_t *slave, modbus_register_t *reg);
  */
 int modbus_slave_rtu_handle(modbus_slave_t *slave, uint8_t *buf, uint16_t len);
 
+/**
+ * @brief This function is used to handle a request without RTU framing, e.g. from Modbus TCP or UDP.
+ *
+ * The request is the unit ID followed by the PDU, which is what follows the
+ * first six Bytes of an MBAP header. The reply is written in place in the same
+ * form and is not passed to slave->on_write; the transport sends it. The buffer
+ * must hold at least 256 Bytes.
+ *
+ * @param slave Pointer to the Modbus slave.
+ * @param buf Pointer to the data buffer.
+ * @param len Length of the data in Bytes.
+ * @param reply_len Pointer to store the reply length in Bytes, 0 if there is no reply.
+ * @return Returns the result of the handling, see modbus_slave_rtu_handle.
+ */
+int modbus_slave_pdu_handle(modbus_slave_t *slave, uint8_t *buf, uint16_t len, uint16_t *reply_len);
+
 int modbus_master_read_registers_rtu(
         uint8_t device_id,
         uint16_t addr, uint16_t quan,
@@ -176,6 +279,171 @@ int modbus_master_write_registers_rtu(
         uint8_t *buf, uint8_t *len
 );
 
+#define MODBUS_DEVICE_HEALTHY 0x00 /**< Polled at the normal rate. */
+#define MODBUS_DEVICE_DEMOTED 0x01 /**< Failed repeatedly, polled at demoted_interval. */
+
+/**
+ * @brief Per-device response timing of a Modbus master.
+ *
+ * The response timeout follows the TCP retransmission timer (RFC 6298):
+ * SRTT and RTTVAR are updated from every measured round-trip time and the
+ * timeout is SRTT + 4 * RTTVAR. Each timeout doubles it, and after
+ * demote_threshold consecutive timeouts the device is only polled every
+ * demoted_interval until it answers again. All times are in the same
+ * ticks, typically milliseconds.
+ */
+typedef struct modbus_master_device_s {
+    uint32_t srtt; /**< Smoothed round-trip time, scaled by 8. */
+    uint32_t rttvar; /**< Round-trip time variation, scaled by 4. */
+    uint32_t rto; /**< Current response timeout. */
+    uint32_t min_rto; /**< Lower bound of the response timeout. */
+    uint32_t max_rto; /**< Upper bound of the response timeout, also used before the first response. */
+    uint16_t failures; /**< Consecutive timeouts. */
+    uint16_t demote_threshold; /**< Consecutive timeouts before demotion, 0 never demotes. */
+    uint32_t demoted_interval; /**< Poll interval while demoted. */
+    uint32_t next_poll; /**< Earliest time of the next poll while demoted. */
+    uint8_t state; /**< MODBUS_DEVICE_HEALTHY or MODBUS_DEVICE_DEMOTED. */
+    uint32_t rtt_last; /**< Last measured round-trip time. */
+    uint32_t rtt_min; /**< Lowest measured round-trip time. */
+    uint32_t rtt_max; /**< Highest measured round-trip time. */
+    uint32_t responses; /**< Number of measured responses. */
+    uint32_t timeouts; /**< Number of timeouts. */
+} modbus_master_device_t;
+
+/**
+ * @brief Initializes the response timing of a device.
+ * @param dev Pointer to the device timing to be initialized.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_master_device_init(modbus_master_device_t *dev);
+
+/**
+ * @brief Checks whether a device should be polled now.
+ * @param dev Pointer to the device timing.
+ * @param now Current time.
+ * @return Returns 1 if the device should be polled, 0 if a demoted device is not due yet.
+ */
+int modbus_master_device_ready(const modbus_master_device_t *dev, uint32_t now);
+
+/**
+ * @brief Feeds a measured round-trip time into the timing of a device.
+ *
+ * Only requests answered on the first attempt should be measured, since the
+ * response to a retried request can not be matched to one attempt (Karn's algorithm).
+ *
+ * @param dev Pointer to the device timing.
+ * @param rtt Time from sending the request to receiving the complete response.
+ * @return Returns the new response timeout.
+ */
+uint32_t modbus_master_device_on_response(modbus_master_device_t *dev, uint32_t rtt);
+
+/**
+ * @brief Records a response timeout of a device, backing off its timeout.
+ * @param dev Pointer to the device timing.
+ * @param now Current time.
+ * @return Returns the new response timeout.
+ */
+uint32_t modbus_master_device_on_timeout(modbus_master_device_t *dev, uint32_t now);
+
+#define MODBUS_TAG_UINT16  0x00 /**< One register, unsigned. */
+#define MODBUS_TAG_INT16   0x01 /**< One register, signed. */
+#define MODBUS_TAG_UINT32  0x02 /**< Two registers, high word first, unsigned. */
+#define MODBUS_TAG_INT32   0x03 /**< Two registers, high word first, signed. */
+#define MODBUS_TAG_FLOAT32 0x04 /**< Two registers, high word first, IEEE 754. */
+
+#define MODBUS_DEADBAND_NONE     0x00 /**< Report every change. */
+#define MODBUS_DEADBAND_ABSOLUTE 0x01 /**< Report when |new - last| > deadband. */
+#define MODBUS_DEADBAND_PERCENT  0x02 /**< Report when |new - last| > |last| * deadband / 100. */
+
+/**
+ * @brief Modbus tag structure.
+ */
+struct modbus_tag_s;
+
+/**
+ * @brief Typedef for modbus tag.
+ */
+typedef struct modbus_tag_s modbus_tag_t;
+
+/**
+ * @brief Modbus tag, a decoded value inside a polled register range.
+ */
+struct modbus_tag_s {
+    uint16_t offset; /**< Register offset inside the polled range, starting from 0. */
+    uint8_t type; /**< Value type, one of MODBUS_TAG_*. */
+    uint8_t deadband_type; /**< Deadband type, one of MODBUS_DEADBAND_*. */
+    double deadband; /**< Absolute deadband, or percent of the last reported value. */
+    double value; /**< Last reported value. */
+};
+
+/**
+ * @brief Initializes a Modbus tag structure.
+ * @param tag Pointer to the Modbus tag to be initialized.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_tag_init(modbus_tag_t *tag);
+
+/**
+ * @brief Modbus change detector structure.
+ */
+struct modbus_change_detector_s;
+
+/**
+ * @brief Typedef for modbus change detector.
+ */
+typedef struct modbus_change_detector_s modbus_change_detector_t;
+
+/**
+ * @brief Modbus tag change callback prototype.
+ * @param det Pointer to the Modbus change detector.
+ * @param tag Pointer to the changed tag, tag->value still holds the previously reported value.
+ * @param value The new decoded value.
+ * @return Return value indicating the result of the callback.
+ */
+typedef int (*modbus_tag_change_cb)(modbus_change_detector_t *det, modbus_tag_t *tag, double value);
+
+/**
+ * @brief Modbus change detector, keeps the previous register image of one read request.
+ */
+struct modbus_change_detector_s {
+    uint8_t device_id; /**< Device ID of the polled request. */
+    uint8_t function_code; /**< Function code of the polled request. */
+    uint16_t addr; /**< Starting address of the polled request. */
+    uint16_t quan; /**< Register quantity of the polled request. */
+    uint8_t *image; /**< Previous register image, at least quan * 2 bytes. */
+    modbus_tag_t *tags; /**< Tags decoded from the register image. */
+    uint16_t tag_len; /**< Length of the tag array. */
+    uint16_t integrity_interval; /**< Report every tag once per this many polls, 0 disables. */
+    uint16_t polls; /**< Polls since the last full report. */
+    uint8_t primed; /**< Whether the register image holds a previous response. */
+    modbus_tag_change_cb on_change; /**< Callback for every reported tag. */
+};
+
+/**
+ * @brief Initializes a Modbus change detector structure.
+ * @param det Pointer to the Modbus change detector to be initialized.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_change_detector_init(modbus_change_detector_t *det);
+
+/**
+ * @brief Feeds a read registers RTU response into a Modbus change detector.
+ *
+ * The response is compared against the previous register image as a whole
+ * first, so an unchanged poll costs one block compare. Only tags whose raw
+ * registers changed are decoded, and a decoded tag is reported through
+ * on_change when it leaves its deadband around the last reported value.
+ * The first response and every integrity_interval-th response report every tag.
+ *
+ * @param det Pointer to the Modbus change detector.
+ * @param buf Pointer to the response ADU.
+ * @param len Length of the response in Bytes.
+ * @return Returns the number of reported tags, or:
+ *         - -1: ADU is not a response to this request
+ *         - -2: ADU is not valid (too short, wrong byte count or wrong CRC)
+ */
+int modbus_master_detect_changes(modbus_change_detector_t *det, const uint8_t *buf, uint16_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,125 @@
+#ifndef MODBUS_SHM_H
+#define MODBUS_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "modbus.h"
+
+#define MODBUS_SHM_MAGIC      0x4D425348 /**< "MBSH" */
+#define MODBUS_SHM_VERSION    1
+#define MODBUS_SHM_SPIN_LIMIT 1000 /**< Retries before a reader gives up on a block being written. */
+
+/**
+ * @brief Layout header at the beginning of a shared register image.
+ *
+ * The header is followed by block_count blocks of block_stride Bytes. Each
+ * block starts with a 32-bit sequence counter, which is odd while a writer
+ * updates the block, followed by block_size registers in Modbus byte order.
+ */
+typedef struct modbus_shm_header_s {
+    uint32_t magic; /**< MODBUS_SHM_MAGIC, written last when the image is ready. */
+    uint16_t version; /**< MODBUS_SHM_VERSION of the layout. */
+    uint16_t header_size; /**< Size of this header in Bytes. */
+    uint16_t reg_count; /**< Number of registers in the image. */
+    uint16_t block_size; /**< Registers per block. */
+    uint16_t block_count; /**< Number of blocks. */
+    uint16_t block_stride; /**< Bytes per block, including the sequence counter. */
+} modbus_shm_header_t;
+
+/**
+ * @brief Handle of a mapped shared register image.
+ */
+typedef struct modbus_shm_s {
+    modbus_shm_header_t *header; /**< Mapped layout header. */
+    uint8_t *blocks; /**< First block. */
+    size_t size; /**< Size of the mapping in Bytes. */
+} modbus_shm_t;
+
+/**
+ * @brief Creates a named shared register image and maps it.
+ * @param shm Pointer to the handle to be initialized.
+ * @param name POSIX shared memory name, e.g. "/modbus0".
+ * @param reg_count Number of registers in the image.
+ * @param block_size Registers per block, at most 32764. Values that must be read
+ *        consistently should not cross a block boundary.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_shm_create(modbus_shm_t *shm, const char *name, uint16_t reg_count, uint16_t block_size);
+
+/**
+ * @brief Maps an existing named shared register image.
+ * @param shm Pointer to the handle to be initialized.
+ * @param name POSIX shared memory name.
+ * @return Returns 0 on success, or a negative value if an error occurred
+ *         or the layout is not compatible or not consistent.
+ */
+int modbus_shm_open(modbus_shm_t *shm, const char *name);
+
+/**
+ * @brief Unmaps a shared register image.
+ * @param shm Pointer to the handle.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_shm_close(modbus_shm_t *shm);
+
+/**
+ * @brief Removes a named shared register image. Existing mappings stay valid.
+ * @param name POSIX shared memory name.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_shm_unlink(const char *name);
+
+/**
+ * @brief Writes registers into a shared register image.
+ *
+ * Each touched block is updated between two increments of its sequence
+ * counter, so readers never accept a half-written block. A writer takes the
+ * counter from even to odd atomically, so several writers of a block, e.g. the
+ * producer and the FC10 handler of a slave built with modbus_shm_register_map,
+ * exclude each other.
+ *
+ * @param shm Pointer to the handle.
+ * @param addr Starting address, starting from 0.
+ * @param regs Registers in Modbus byte order.
+ * @param quan Quantity of registers.
+ * @return Returns 0 on success, or a negative value if the range is invalid
+ *         or a block stayed locked by another writer.
+ */
+int modbus_shm_write(modbus_shm_t *shm, uint16_t addr, const uint8_t *regs, uint16_t quan);
+
+/**
+ * @brief Reads registers from a shared register image consistently per block.
+ * @param shm Pointer to the handle.
+ * @param addr Starting address, starting from 0.
+ * @param regs Buffer to store the registers in Modbus byte order.
+ * @param quan Quantity of registers.
+ * @return Returns 0 on success, or a negative value if the range is invalid
+ *         or a block stayed locked by a writer.
+ */
+int modbus_shm_read(modbus_shm_t *shm, uint16_t addr, uint8_t *regs, uint16_t quan);
+
+/**
+ * @brief Builds the register map of a Modbus slave directly over a shared register image.
+ *
+ * One register node per block is initialized and added to the slave. The node
+ * data points into the mapping and the load and store callbacks access it
+ * through the block sequence counter, so FC03 replies are copied straight out
+ * of shared memory and each block is read consistently, and FC10 writes take
+ * the block like any other writer. Requests may start and end inside a block,
+ * a request crossing a block boundary is consistent per block only.
+ *
+ * @param shm Pointer to the handle.
+ * @param slave Pointer to the Modbus slave.
+ * @param regs Array of header->block_count register nodes.
+ * @param index Register index of the first register, starting from 1.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_shm_register_map(modbus_shm_t *shm, modbus_slave_t *slave, modbus_register_t *regs, uint16_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MODBUS_SHM_H*/
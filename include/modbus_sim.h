@@ -0,0 +1,187 @@
+#ifndef MODBUS_SIM_H
+#define MODBUS_SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "modbus.h"
+
+#define MODBUS_SIM_PAGE_SIZE 16 /**< Registers per copy-on-write page. */
+#define MODBUS_SIM_NO_PAGE   0xFFFF /**< End of a page list. */
+
+#define MODBUS_SIM_WAVE_RAMP     0x01 /**< Rises from min to max, then restarts. */
+#define MODBUS_SIM_WAVE_TRIANGLE 0x02 /**< Rises from min to max and falls back. */
+#define MODBUS_SIM_WAVE_SQUARE   0x03 /**< Holds min for half a period, then max. */
+
+/**
+ * @brief Generated waveform of one simulated register, computed on read.
+ */
+typedef struct modbus_sim_wave_s {
+    uint16_t addr; /**< Register address, starting from 0. */
+    uint8_t shape; /**< Waveform shape, one of MODBUS_SIM_WAVE_*. */
+    uint16_t period; /**< Period in simulator ticks, 0 holds min. */
+    uint16_t min; /**< Lowest value. */
+    uint16_t max; /**< Highest value. */
+} modbus_sim_wave_t;
+
+/**
+ * @brief Immutable register map template shared by all simulated devices.
+ */
+typedef struct modbus_sim_template_s {
+    const uint8_t *image; /**< Initial registers in Modbus byte order, reg_count * 2 bytes. */
+    uint16_t reg_count; /**< Number of registers, addresses 0 to reg_count - 1. */
+    const modbus_sim_wave_t *waves; /**< Generated registers, they shadow written values. */
+    uint16_t wave_len; /**< Length of the waveform array. */
+} modbus_sim_template_t;
+
+/**
+ * @brief Copy-on-write page holding written registers of one device.
+ */
+typedef struct modbus_sim_page_s {
+    uint16_t next; /**< Next page of the same device, or next free page. */
+    uint16_t base; /**< Address of the first register in the page. */
+    uint8_t data[MODBUS_SIM_PAGE_SIZE * 2]; /**< Registers in Modbus byte order. */
+} modbus_sim_page_t;
+
+/**
+ * @brief Per-device state of a simulated device.
+ */
+typedef struct modbus_sim_device_s {
+    uint16_t pages; /**< First written page, MODBUS_SIM_NO_PAGE while pristine. */
+} modbus_sim_device_t;
+
+/**
+ * @brief Modbus simulator structure.
+ */
+struct modbus_sim_s;
+
+/**
+ * @brief Typedef for modbus simulator.
+ */
+typedef struct modbus_sim_s modbus_sim_t;
+
+/**
+ * @brief Modbus simulator reply callback function prototype.
+ * @param sim Pointer to the Modbus simulator.
+ * @param device Index of the simulated device.
+ * @param buf Pointer to the reply.
+ * @param len Length of the reply.
+ * @return Returns a value indicating the result of the callback.
+ *         A negative value indicates an error.
+ */
+typedef int (*modbus_sim_reply_cb)(modbus_sim_t *sim, uint16_t device, uint8_t *buf, uint16_t len);
+
+/**
+ * @brief Modbus simulator, many devices sharing one register map template.
+ *
+ * Requests are handled by an embedded Modbus slave whose single register node
+ * covers the template and reads and writes the current device, so the
+ * simulator must not be moved after initialization.
+ */
+struct modbus_sim_s {
+    const modbus_sim_template_t *tmpl; /**< Shared register map template. */
+    modbus_sim_device_t *devices; /**< Device states. */
+    uint16_t device_len; /**< Number of devices. */
+    modbus_sim_page_t *pages; /**< Page pool shared by all devices. */
+    uint16_t page_len; /**< Number of pages in the pool. */
+    uint16_t free_page; /**< First free page. */
+    uint16_t free_len; /**< Number of free pages. */
+    uint32_t now; /**< Simulator time in ticks, advanced by the application. */
+    modbus_sim_reply_cb on_write; /**< Callback function for device reply. */
+    uint16_t device; /**< Device of the request being handled. */
+    modbus_slave_t slave; /**< Slave handling the requests. */
+    modbus_register_t reg; /**< Register node covering the whole template. */
+};
+
+/**
+ * @brief Initializes a Modbus simulator with all devices in the template state.
+ * @param sim Pointer to the Modbus simulator to be initialized.
+ * @param tmpl Pointer to the shared register map template.
+ * @param devices Device state storage.
+ * @param device_len Number of devices.
+ * @param pages Page pool storage.
+ * @param page_len Number of pages in the pool, at most MODBUS_SIM_NO_PAGE.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_sim_init(modbus_sim_t *sim, const modbus_sim_template_t *tmpl,
+                    modbus_sim_device_t *devices, uint16_t device_len,
+                    modbus_sim_page_t *pages, uint16_t page_len);
+
+/**
+ * @brief Returns a simulated device to the template state and frees its pages.
+ * @param sim Pointer to the Modbus simulator.
+ * @param device Index of the simulated device.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_sim_reset(modbus_sim_t *sim, uint16_t device);
+
+/**
+ * @brief Reads registers of a simulated device.
+ * @param sim Pointer to the Modbus simulator.
+ * @param device Index of the simulated device.
+ * @param addr Starting address, starting from 0.
+ * @param quan Quantity of registers.
+ * @param regs Buffer to store the registers in Modbus byte order.
+ * @return Returns 0 on success, or a negative value if the range is invalid.
+ */
+int modbus_sim_read(modbus_sim_t *sim, uint16_t device, uint16_t addr, uint16_t quan, uint8_t *regs);
+
+/**
+ * @brief Writes registers of a simulated device, copying template pages on first write.
+ * @param sim Pointer to the Modbus simulator.
+ * @param device Index of the simulated device.
+ * @param addr Starting address, starting from 0.
+ * @param quan Quantity of registers.
+ * @param regs Registers in Modbus byte order.
+ * @return Returns 0 on success, or:
+ *         - -1: Range is invalid
+ *         - -2: Page pool is exhausted, nothing was written
+ */
+int modbus_sim_write(modbus_sim_t *sim, uint16_t device, uint16_t addr, uint16_t quan, const uint8_t *regs);
+
+/**
+ * @brief Handles incoming RTU data for a simulated device.
+ *
+ * The transport selects the device, e.g. from the listening port. The unit ID
+ * of the request is echoed in the reply.
+ *
+ * @param sim Pointer to the Modbus simulator.
+ * @param device Index of the simulated device.
+ * @param buf Pointer to the data buffer, the reply is written in place.
+ * @param len Length of the data in Bytes.
+ * @return Returns the result of the handling:
+ *         -  0: OK
+ *         -  1: Function not supported
+ *         -  2: Invalid data address
+ *         -  3: Invalid data value
+ *         -  4: Internal error
+ *         - -1: Device does not exist
+ *         - -2: ADU is not valid (too short or wrong CRC)
+ */
+int modbus_sim_rtu_handle(modbus_sim_t *sim, uint16_t device, uint8_t *buf, uint16_t len);
+
+/**
+ * @brief Handles a request without RTU framing, selecting the device by its unit ID.
+ *
+ * Unit ID 1 addresses the device base, unit ID 2 the device base + 1 and so on,
+ * so one transport serves up to 247 devices and several transports can serve
+ * disjoint device ranges. The buffer layout and the reply are the same as for
+ * modbus_slave_pdu_handle, on_write is not called.
+ *
+ * @param sim Pointer to the Modbus simulator.
+ * @param base Index of the device addressed by unit ID 1.
+ * @param buf Pointer to the request, the reply is written in place.
+ * @param len Length of the request in Bytes.
+ * @param reply_len Pointer to store the reply length in Bytes, 0 if there is no reply.
+ * @return Returns the result of the handling like modbus_sim_rtu_handle, -1 if
+ *         the unit ID is not within 1 to 247 or the device does not exist, -2 if
+ *         the request is too short.
+ */
+int modbus_sim_pdu_handle(modbus_sim_t *sim, uint16_t base, uint8_t *buf, uint16_t len, uint16_t *reply_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MODBUS_SIM_H*/
@@ -0,0 +1,104 @@
+#ifndef MODBUS_TRACE_H
+#define MODBUS_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define MODBUS_TRACE_FRAME_BEGIN  0x01 /**< Frame received, arg is the length. */
+#define MODBUS_TRACE_FRAME_END    0x02 /**< Frame handled, arg is the result code. */
+#define MODBUS_TRACE_CRC_CHECKED  0x03 /**< CRC verified, arg is the function code. */
+#define MODBUS_TRACE_LOOKUP_DONE  0x04 /**< Starting register found, arg is its index. */
+#define MODBUS_TRACE_REG_CB_BEGIN 0x05 /**< Register callback entered, arg is the register index. */
+#define MODBUS_TRACE_REG_CB_END   0x06 /**< Register callback returned, arg is the register index. */
+#define MODBUS_TRACE_REPLY_BEGIN  0x07 /**< Reply handed to slave->on_write, arg is the length. */
+#define MODBUS_TRACE_REPLY_END    0x08 /**< slave->on_write returned, arg is the length. */
+
+/**
+ * @brief Modbus trace event.
+ */
+typedef struct modbus_trace_event_s {
+    uint32_t time; /**< Timestamp in clock ticks. */
+    uint16_t type; /**< Event type, one of MODBUS_TRACE_*. */
+    uint16_t arg; /**< Event argument. */
+} modbus_trace_event_t;
+
+/**
+ * @brief Modbus trace clock prototype.
+ * @return Returns a free-running timestamp in ticks, wrapping around is allowed.
+ */
+typedef uint32_t (*modbus_trace_clock_cb)(void);
+
+/**
+ * @brief Modbus trace ring buffer.
+ *
+ * The ring has a single producer, the thread handling the slave it is attached
+ * to, and never blocks it. Any other thread may dump it concurrently.
+ */
+typedef struct modbus_trace_s {
+    modbus_trace_event_t *events; /**< Event storage. */
+    uint32_t capacity; /**< Number of events, a power of two. */
+    uint32_t head; /**< Number of events recorded so far. */
+    modbus_trace_clock_cb clock; /**< Timestamp source. */
+} modbus_trace_t;
+
+/**
+ * @brief Initializes a Modbus trace ring buffer.
+ * @param trace Pointer to the ring buffer to be initialized.
+ * @param events Event storage.
+ * @param capacity Number of events in the storage, a power of two.
+ * @param clock Timestamp source.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_trace_init(modbus_trace_t *trace, modbus_trace_event_t *events, uint32_t capacity,
+                      modbus_trace_clock_cb clock);
+
+/**
+ * @brief Records an event into a Modbus trace ring buffer, overwriting the oldest one.
+ * @param trace Pointer to the ring buffer.
+ * @param type Event type, one of MODBUS_TRACE_*.
+ * @param arg Event argument.
+ */
+void modbus_trace_record(modbus_trace_t *trace, uint16_t type, uint16_t arg);
+
+/**
+ * @brief Copies the most recent events out of a Modbus trace ring buffer.
+ *
+ * Events that the producer overwrote during the copy are dropped, so the
+ * result is always consistent. Once the ring has wrapped, the oldest slot is
+ * never returned because the producer may be writing it.
+ *
+ * @param trace Pointer to the ring buffer.
+ * @param out Buffer to store the events, oldest first.
+ * @param max Size of the buffer in events.
+ * @return Returns the number of copied events.
+ */
+uint32_t modbus_trace_dump(modbus_trace_t *trace, modbus_trace_event_t *out, uint32_t max);
+
+/**
+ * @brief Writes events in the Chrome trace event JSON format, readable by Perfetto.
+ * @param fp Output file.
+ * @param events Events, oldest first.
+ * @param len Number of events.
+ * @param ticks_per_us Clock ticks per microsecond.
+ * @param tid Thread ID shown for the events, e.g. the slave ID.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_trace_write_chrome_json(FILE *fp, const modbus_trace_event_t *events, uint32_t len,
+                                   double ticks_per_us, int tid);
+
+#ifdef MODBUS_TRACE
+#define MODBUS_TRACE_EVENT(slave, type, arg) \
+    do { if ((slave)->trace != NULL) modbus_trace_record((slave)->trace, (type), (uint16_t) (arg)); } while (0)
+#else
+#define MODBUS_TRACE_EVENT(slave, type, arg) do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MODBUS_TRACE_H*/
@@ -0,0 +1,106 @@
+#ifndef MODBUS_UDP_H
+#define MODBUS_UDP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/socket.h>
+
+#include "modbus.h"
+#include "modbus_sim.h"
+
+#define MODBUS_UDP_BATCH     32 /**< Datagrams per recvmmsg/sendmmsg call. */
+#define MODBUS_UDP_ADU_SIZE  260 /**< Largest MBAP ADU: 7 Bytes header and 253 Bytes PDU. */
+#define MODBUS_UDP_SLOT_SIZE 264 /**< Reply slot size, room for the ADU and a cached CRC16. */
+#define MODBUS_UDP_GRO_SIZE  65535 /**< Receive slot size needed to enable UDP GRO. */
+
+/**
+ * @brief Reply slot of the Modbus UDP transmit ring.
+ */
+typedef struct modbus_udp_slot_s {
+    struct sockaddr_storage addr; /**< Peer address. */
+    socklen_t addr_len; /**< Length of the peer address. */
+    uint16_t len; /**< Length of the reply ADU. */
+    uint8_t buf[MODBUS_UDP_SLOT_SIZE]; /**< Reply ADU, built in place from the request. */
+} modbus_udp_slot_t;
+
+/**
+ * @brief Modbus UDP slave transport.
+ *
+ * Requests are received in batches with recvmmsg into a caller-provided
+ * receive region split into MODBUS_UDP_BATCH slots, and replies are sent in
+ * batches with sendmmsg from a fixed transmit ring. When the receive slots are
+ * at least MODBUS_UDP_GRO_SIZE Bytes and the kernel supports it, UDP GRO lets
+ * one slot carry several coalesced requests of the same peer.
+ */
+typedef struct modbus_udp_s {
+    int fd; /**< Bound UDP socket. */
+    modbus_slave_t *slave; /**< Slave handling the requests, unless sim is set. */
+    modbus_sim_t *sim; /**< Simulator handling the requests, or NULL. */
+    uint16_t sim_base; /**< Simulated device addressed by unit ID 1. */
+    uint8_t *rx; /**< Receive region. */
+    size_t rx_slot_size; /**< Size of one receive slot in Bytes. */
+    int gro; /**< Whether UDP GRO is enabled. */
+    struct sockaddr_storage rx_addr[MODBUS_UDP_BATCH]; /**< Peer addresses of received datagrams. */
+    modbus_udp_slot_t tx[MODBUS_UDP_BATCH]; /**< Transmit ring. */
+    uint16_t tx_len; /**< Number of pending replies. */
+    uint32_t requests; /**< Number of handled requests. */
+    uint32_t recv_calls; /**< Number of receive system calls. */
+    uint32_t send_calls; /**< Number of send system calls. */
+} modbus_udp_t;
+
+/**
+ * @brief Initializes a Modbus UDP slave transport.
+ * @param udp Pointer to the transport to be initialized.
+ * @param fd Bound UDP socket.
+ * @param slave Pointer to the Modbus slave.
+ * @param rx Receive region.
+ * @param rx_size Size of the receive region in Bytes, at least
+ *        MODBUS_UDP_BATCH * MODBUS_UDP_ADU_SIZE.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_udp_init(modbus_udp_t *udp, int fd, modbus_slave_t *slave, uint8_t *rx, size_t rx_size);
+
+/**
+ * @brief Initializes a Modbus UDP transport serving simulated devices.
+ *
+ * The unit ID selects the device, see modbus_sim_pdu_handle. Serve more than
+ * 247 devices with one transport per socket and disjoint device bases.
+ *
+ * @param udp Pointer to the transport to be initialized.
+ * @param fd Bound UDP socket.
+ * @param sim Pointer to the Modbus simulator.
+ * @param base Index of the device addressed by unit ID 1.
+ * @param rx Receive region.
+ * @param rx_size Size of the receive region in Bytes, at least
+ *        MODBUS_UDP_BATCH * MODBUS_UDP_ADU_SIZE.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+int modbus_udp_init_sim(modbus_udp_t *udp, int fd, modbus_sim_t *sim, uint16_t base, uint8_t *rx, size_t rx_size);
+
+/**
+ * @brief Receives a batch of requests, handles them and sends all replies.
+ *
+ * Blocks until at least one datagram arrives unless the socket is non-blocking.
+ * Malformed datagrams and requests for other unit IDs are dropped.
+ *
+ * @param udp Pointer to the transport.
+ * @return Returns the number of handled requests, or a negative value if
+ *         receiving failed (see errno).
+ */
+int modbus_udp_poll(modbus_udp_t *udp);
+
+/**
+ * @brief Receives, handles and answers a single request, one system call per datagram.
+ * @param udp Pointer to the transport.
+ * @return Returns the number of handled requests, or a negative value if
+ *         receiving failed (see errno).
+ */
+int modbus_udp_poll_one(modbus_udp_t *udp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MODBUS_UDP_H*/
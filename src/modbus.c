@@ -1,5 +1,8 @@
 #include "modbus.h"
 
+#include "modbus_atomic.h"
+#include "modbus_trace.h"
+
 /**
  * @brief CCITT CRC16 Lookup Table
  *
@@ -43,17 +46,7 @@ static uint16_t ccitt_table[256] =
          0x4040,
         };
 
-/**
- * @brief Calculate the Modbus CRC16 checksum for a given buffer.
- *
- * This function calculates the Modbus CRC16 checksum for the specified buffer.
- * It uses the CCITT CRC16 lookup table for efficient computation.
- *
- * @param buf The input buffer.
- * @param len The length of the buffer.
- * @return The calculated CRC16 checksum.
- */
-static uint16_t modbus_crc16(uint8_t *buf, int len) {
+uint16_t modbus_crc16(const uint8_t *buf, int len) {
     uint16_t crc = 0xffff;
     while (len-- > 0) { crc = ccitt_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8); }
     return crc;
@@ -87,6 +80,8 @@ int modbus_register_init(modbus_register_t *reg) {
     reg->next = NULL;
     reg->on_read = NULL;
     reg->on_write = NULL;
+    reg->load = NULL;
+    reg->store = NULL;
     return 0;
 }
 
@@ -96,6 +91,14 @@ int modbus_slave_init(modbus_slave_t *slave) {
     slave->register_len = 0;
     slave->on_read = NULL;
     slave->on_write = NULL;
+    slave->on_write_batch = NULL;
+    slave->dirty_map = NULL;
+    slave->dirty_map_size = 0;
+    slave->cache = NULL;
+    slave->cache_len = 0;
+#ifdef MODBUS_TRACE
+    slave->trace = NULL;
+#endif
     return 0;
 }
 
@@ -107,6 +110,7 @@ int modbus_slave_add_register(modbus_slave_t *slave, modbus_register_t *reg) {
     }
     reg_last->next = reg;
     slave->register_len++;
+    modbus_slave_invalidate(slave, 0, 0xFFFF);
     return 0;
 }
 
@@ -115,6 +119,7 @@ int modbus_slave_remove_register(modbus_slave_t *slave, modbus_register_t *reg)
     for (reg_now = &slave->register_entry; reg_now != NULL; reg_now = reg_now->next) {
         if (reg_now == reg) {
             reg_prev->next = reg_now->next;
+            modbus_slave_invalidate(slave, 0, 0xFFFF);
             break;
         }
         reg_prev = reg_now;
@@ -127,7 +132,8 @@ int modbus_slave_remove_register(modbus_slave_t *slave, modbus_register_t *reg)
  *
  * This function is used to find a Modbus slave register based on the given
  * register address. It searches the register chain list of the specified slave
- * and returns the found register pointer through the 'reg' parameter. If the
+ * and returns the found register pointer through the 'reg' parameter. Nodes with
+ * a load or store callback are also found by addresses inside of them. If the
  * register is not found, the 'reg' parameter will not be modified.
  *
  * @param slave Pointer to the Modbus slave.
@@ -140,7 +146,9 @@ static int modbus_slave_find_register(modbus_slave_t *slave, uint16_t addr_start
     modbus_register_t *reg_now;
     /* Iterate through the register chain list */
     for (reg_now = &slave->register_entry; reg_now != NULL; reg_now = reg_now->next) {
-        if (reg_now->index == addr_start) {
+        if (reg_now->index == addr_start ||
+            ((reg_now->load != NULL || reg_now->store != NULL) &&
+             reg_now->index < addr_start && addr_start < reg_now->index + reg_now->size)) {
             reg_found = 1;
             *reg = reg_now;
             break;
@@ -149,6 +157,122 @@ static int modbus_slave_find_register(modbus_slave_t *slave, uint16_t addr_start
     return reg_found;
 }
 
+/**
+ * @brief Marks a range of registers in the dirty bitmap of a Modbus slave.
+ *
+ * Addresses outside of the bitmap are ignored. Bits are set with atomic OR so
+ * that a concurrent modbus_slave_consume_dirty never loses a mark.
+ *
+ * @param slave Pointer to the Modbus slave.
+ * @param addr Starting address, starting from 0.
+ * @param quan Quantity of registers.
+ */
+static void modbus_slave_mark_dirty_map(modbus_slave_t *slave, uint16_t addr, uint16_t quan) {
+    uint32_t bit, end = (uint32_t) addr + quan, limit = (uint32_t) slave->dirty_map_size * 8;
+    uint8_t mask;
+    if (end > limit) end = limit;
+    for (bit = addr; bit < end; bit = (bit | 7) + 1) {
+        mask = (uint8_t) (0xFF << (bit & 7));
+        if ((bit | 7) >= end) mask &= (uint8_t) (0xFF >> (7 - ((end - 1) & 7)));
+        MODBUS_ATOMIC_OR(&slave->dirty_map[bit >> 3], mask);
+    }
+}
+
+int modbus_slave_consume_dirty(modbus_slave_t *slave, uint16_t *addr, uint16_t *quan) {
+    uint16_t i, count = 0;
+    uint8_t bits, bit = 0;
+    for (i = 0; i < slave->dirty_map_size; i++) {
+        if (MODBUS_ATOMIC_LOAD(&slave->dirty_map[i]) == 0) continue;
+        MODBUS_ATOMIC_XCHG(&slave->dirty_map[i], 0, bits);
+        if (bits == 0) continue;
+        /* Find the first dirty register */
+        while (!(bits & (1 << bit))) bit++;
+        *addr = (uint16_t) (i * 8 + bit);
+        while (1) {
+            /* Consume the run inside this byte */
+            while (bit < 8 && (bits & (1 << bit))) {
+                bits &= (uint8_t) ~(1 << bit);
+                bit++;
+                count++;
+            }
+            /* The run ends inside this byte or at the end of the bitmap */
+            if (bit < 8 || i + 1 >= slave->dirty_map_size) break;
+            /* The run may continue in the next byte */
+            i++;
+            bit = 0;
+            MODBUS_ATOMIC_XCHG(&slave->dirty_map[i], 0, bits);
+            if (!(bits & 1)) break;
+        }
+        /* Put back the marks behind the run */
+        if (bits != 0) {
+            MODBUS_ATOMIC_OR(&slave->dirty_map[i], bits);
+        }
+        *quan = count;
+        return 1;
+    }
+    return 0;
+}
+
+int modbus_slave_invalidate(modbus_slave_t *slave, uint16_t addr, uint16_t quan) {
+    uint16_t i;
+    uint32_t end = (uint32_t) addr + quan;
+    modbus_cache_entry_t *entry;
+    for (i = 0; i < slave->cache_len; i++) {
+        entry = &slave->cache[i];
+        if (entry->valid && entry->addr < end && addr < (uint32_t) entry->addr + entry->quan) {
+            entry->valid = 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the reply cache slot of a request.
+ * @param slave Pointer to the Modbus slave, with a reply cache.
+ * @param addr_start Starting address of the request.
+ * @param reg_quantity Register quantity of the request.
+ * @return Pointer to the cache slot.
+ */
+static modbus_cache_entry_t *modbus_slave_cache_slot(modbus_slave_t *slave, uint16_t addr_start, uint16_t reg_quantity) {
+    return &slave->cache[((uint32_t) addr_start * 31 + reg_quantity) % slave->cache_len];
+}
+
+/**
+ * @brief Hands a complete RTU reply to the on_write callback of a Modbus slave.
+ * @param slave Pointer to the Modbus slave.
+ * @param buf Pointer to the reply, including the CRC16 checksum.
+ * @param len Length of the reply in Bytes.
+ */
+static void modbus_slave_emit_rtu(modbus_slave_t *slave, uint8_t *buf, uint16_t len) {
+    if (slave->on_write != NULL) {
+        MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REPLY_BEGIN, len);
+        slave->on_write(slave, buf, len);
+        MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REPLY_END, len);
+    }
+}
+
+/**
+ * @brief Finishes a reply built in place in the request buffer.
+ *
+ * For RTU the CRC16 checksum is appended and the reply is handed to on_write.
+ * Without RTU framing only the reply length is returned to the transport.
+ *
+ * @param slave Pointer to the Modbus slave.
+ * @param buf Pointer to the reply, starting with the unit ID.
+ * @param len Length of the reply in Bytes, without CRC16 checksum.
+ * @param pdu_len Pointer to store the reply length, or NULL for RTU framing.
+ */
+static void modbus_slave_send_reply(modbus_slave_t *slave, uint8_t *buf, uint16_t len, uint16_t *pdu_len) {
+    uint16_t crc16;
+    if (pdu_len != NULL) {
+        *pdu_len = len;
+        return;
+    }
+    crc16 = modbus_crc16(buf, len);
+    memcpy(&buf[len], &crc16, 2);
+    modbus_slave_emit_rtu(slave, buf, len + 2);
+}
+
 /**
  * @brief Handles RTU exception in Modbus slave.
  *
@@ -164,20 +288,14 @@ static int modbus_slave_find_register(modbus_slave_t *slave, uint16_t addr_start
  *      - 0x02: invalid register address.
  *      - 0x03: invalid register quantity.
  *      - 0x04: internal error.
+ * @param pdu_len Pointer to store the reply length, or NULL for RTU framing.
  * @return Exception code.
  */
-static int modbus_slave_handle_rtu_exception(modbus_slave_t *slave, uint8_t *buf, uint8_t code) {
-    uint16_t crc16;
-
+static int modbus_slave_handle_rtu_exception(modbus_slave_t *slave, uint8_t *buf, uint8_t code, uint16_t *pdu_len) {
     buf[1] += 0x80; /* Set the MSB of the function code to indicate an exception */
     buf[2] = code; /* Set the exception code */
 
-    crc16 = modbus_crc16(buf, 3); /* Calculate CRC16 checksum for the modified buffer */
-    memcpy(&buf[3], &crc16, 2); /* Append the CRC16 checksum to the buffer */
-
-    if (slave->on_write != NULL) {
-        slave->on_write(slave, buf, 5); /* Call the on_reply callback function with the modified buffer */
-    }
+    modbus_slave_send_reply(slave, buf, 3, pdu_len);
 
     return code;
 }
@@ -186,66 +304,125 @@ static int modbus_slave_handle_rtu_exception(modbus_slave_t *slave, uint8_t *buf
  * @brief Handles the Modbus function code 03 (Read Holding Registers) in Modbus RTU.
  * @param slave Pointer to the Modbus slave structure.
  * @param buf Pointer to the buffer containing the received Modbus RTU request.
+ * @param pdu_len Pointer to store the reply length, or NULL for RTU framing.
  * @return 0 on successful handling of the function code, an error code otherwise.
  *     - 0x02: Invalid register address.
  *     - 0x03: Invalid register quantity.
  */
-static int modbus_slave_handle_rtu_fc03(modbus_slave_t *slave, uint8_t *buf) {
-    int reg_found;
-    uint16_t addr_start, reg_quantity, copied = 0, crc16;
+static int modbus_slave_handle_rtu_fc03(modbus_slave_t *slave, uint8_t *buf, uint16_t *pdu_len) {
+    int reg_found, rc, cacheable = 1;
+    uint16_t addr_start, reg_quantity, copied = 0, crc16, offset, chunk;
     modbus_register_t *reg_now;
+    modbus_cache_entry_t *entry;
 
     /* Extract addr_start and reg_quantity */
     addr_start = modbus_reg_to_uint16(&buf[2]);
     reg_quantity = modbus_reg_to_uint16(&buf[4]);
 
+    /* A reply holds at most 125 registers */
+    if (reg_quantity == 0 || reg_quantity > 125) {
+        return modbus_slave_handle_rtu_exception(slave, buf, 0x03, pdu_len);
+    }
+
+    /* Send the cached reply on a hit */
+    if (slave->cache_len != 0) {
+        entry = modbus_slave_cache_slot(slave, addr_start, reg_quantity);
+        if (entry->valid && entry->frame[0] == buf[0] && entry->function_code == buf[1] &&
+            entry->addr == addr_start && entry->quan == reg_quantity) {
+            if (pdu_len != NULL) {
+                /* Without RTU framing the cached CRC is not sent */
+                memcpy(buf, entry->frame, entry->len - 2);
+                *pdu_len = entry->len - 2;
+            } else {
+                memcpy(buf, entry->frame, entry->len);
+                modbus_slave_emit_rtu(slave, buf, entry->len);
+            }
+            return 0;
+        }
+    }
+
     /* Find and validate the starting register */
     reg_found = modbus_slave_find_register(slave, addr_start + 1, &reg_now);
     if (!reg_found) {
         /* Handle the exception case of an invalid register address */
-        return modbus_slave_handle_rtu_exception(slave, buf, 0x02);
+        return modbus_slave_handle_rtu_exception(slave, buf, 0x02, pdu_len);
     }
+    offset = (uint16_t) (addr_start + 1 - reg_now->index);
+    if (offset != 0 && reg_now->load == NULL) {
+        return modbus_slave_handle_rtu_exception(slave, buf, 0x02, pdu_len);
+    }
+    MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_LOOKUP_DONE, reg_now->index);
 
-    /* Copy registers */
-    while (1) {
-        /* Done */
-        if (copied == reg_quantity * 2) {
-            break;
-        }
-
+    /* Copy registers, only nodes with a load callback may be read partially */
+    while (copied < reg_quantity * 2) {
         /* When error occurs */
         if (reg_now == NULL ||
-            (reg_now->index - 1) * 2 != copied + addr_start * 2 ||
-            copied > reg_quantity * 2) {
+            (reg_now->index - 1 + offset) * 2 != copied + addr_start * 2) {
             /* Handle the exception case of an invalid register quantity */
-            return modbus_slave_handle_rtu_exception(slave, buf, 0x03);
+            return modbus_slave_handle_rtu_exception(slave, buf, 0x03, pdu_len);
+        }
+        chunk = (uint16_t) (reg_now->size - offset);
+        if (chunk > reg_quantity - copied / 2) {
+            chunk = (uint16_t) (reg_quantity - copied / 2);
+        }
+        if (reg_now->load == NULL && chunk != reg_now->size) {
+            return modbus_slave_handle_rtu_exception(slave, buf, 0x03, pdu_len);
         }
 
         /* Do read callback */
         if (reg_now->on_read != NULL) {
-            if (reg_now->on_read(reg_now, NULL) < 0) {
-                return modbus_slave_handle_rtu_exception(slave, buf, 0x04);
+            /* The callback may produce a new value on every read */
+            cacheable = 0;
+            MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REG_CB_BEGIN, reg_now->index);
+            rc = reg_now->on_read(reg_now, NULL);
+            MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REG_CB_END, reg_now->index);
+            if (rc < 0) {
+                return modbus_slave_handle_rtu_exception(slave, buf, 0x04, pdu_len);
             }
         }
 
         /* Copy register data to the response buffer */
-        memcpy(&buf[copied + 3], reg_now->data, reg_now->size * 2);
-        copied += reg_now->size * 2;
+        if (reg_now->load != NULL) {
+            /* The node owns its storage, which may change without a write */
+            cacheable = 0;
+            MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REG_CB_BEGIN, reg_now->index);
+            rc = reg_now->load(reg_now, offset, chunk, &buf[copied + 3]);
+            MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REG_CB_END, reg_now->index);
+            if (rc < 0) {
+                return modbus_slave_handle_rtu_exception(slave, buf, 0x04, pdu_len);
+            }
+        } else {
+            memcpy(&buf[copied + 3], reg_now->data, chunk * 2);
+        }
+        copied += chunk * 2;
+        offset = 0;
         reg_now = reg_now->next;
     }
 
     /* Update the response buffer with the copied register quantity */
     buf[2] = (uint8_t) copied;
 
-    /* Calculate and append the CRC16 checksum */
-    crc16 = modbus_crc16(buf, copied + 3);
-    memcpy(&buf[copied + 3], &crc16, 2);
-
-    /* Call the on_reply callback function with the response buffer if registered */
-    if (slave->on_write != NULL) {
-        slave->on_write(slave, buf, copied + 3 + 2);
+    /* Remember the encoded reply, including its CRC16 checksum, if it fits into a cache entry */
+    if (slave->cache_len != 0 && cacheable && (size_t) copied + 3 + 2 <= sizeof(slave->cache->frame)) {
+        crc16 = modbus_crc16(buf, copied + 3);
+        memcpy(&buf[copied + 3], &crc16, 2);
+        entry = modbus_slave_cache_slot(slave, addr_start, reg_quantity);
+        entry->function_code = buf[1];
+        entry->addr = addr_start;
+        entry->quan = reg_quantity;
+        entry->len = copied + 3 + 2;
+        memcpy(entry->frame, buf, entry->len);
+        entry->valid = 1;
+        if (pdu_len == NULL) {
+            /* The checksum is already in place */
+            modbus_slave_emit_rtu(slave, buf, entry->len);
+            return 0;
+        }
     }
 
+    /* Calculate and append the CRC16 checksum and send the reply */
+    modbus_slave_send_reply(slave, buf, copied + 3, pdu_len);
+
     return 0;
 }
 
@@ -258,65 +435,146 @@ static int modbus_slave_handle_rtu_fc03(modbus_slave_t *slave, uint8_t *buf) {
  *     - 0x02: Invalid register address.
  *     - 0x03: Invalid register quantity or byte count.
  *     - 0x04: Internal error during register writing.
+ * @param pdu_len Pointer to store the reply length, or NULL for RTU framing.
  */
-static int modbus_slave_handle_rtu_fc10(modbus_slave_t *slave, uint8_t *buf) {
-    int reg_found;
+static int modbus_slave_handle_rtu_fc10(modbus_slave_t *slave, uint8_t *buf, uint16_t *pdu_len) {
+    int reg_found, rc;
     uint8_t byte_count, copied = 0;
-    uint16_t addr_start, reg_quantity, crc16;
-    modbus_register_t *reg_now;
+    uint16_t addr_start, reg_quantity, offset, offset_first, chunk;
+    modbus_register_t *reg_now, *reg_first;
 
     /* Extract information from the buffer */
     addr_start = modbus_reg_to_uint16(&buf[2]);
     reg_quantity = modbus_reg_to_uint16(&buf[4]);
     byte_count = buf[6];
 
+    /* A request holds at most 123 registers */
+    if (reg_quantity == 0 || reg_quantity > 123 || reg_quantity * 2 != byte_count) {
+        return modbus_slave_handle_rtu_exception(slave, buf, 0x03, pdu_len);
+    }
+
     /* Check the starting address */
     reg_found = modbus_slave_find_register(slave, addr_start + 1, &reg_now);
     if (!reg_found) {
         /* Handle the exception case of an invalid register address */
-        return modbus_slave_handle_rtu_exception(slave, buf, 0x02);
+        return modbus_slave_handle_rtu_exception(slave, buf, 0x02, pdu_len);
     }
+    offset = (uint16_t) (addr_start + 1 - reg_now->index);
+    if (offset != 0 && reg_now->store == NULL) {
+        return modbus_slave_handle_rtu_exception(slave, buf, 0x02, pdu_len);
+    }
+    MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_LOOKUP_DONE, reg_now->index);
 
-    /* Perform on_write callback and copy value to register */
-    while (1) {
-        if (copied == byte_count) {
-            break;
+    /* Check the whole range before anything is written, nodes with a store callback may be written partially */
+    reg_first = reg_now;
+    offset_first = offset;
+    while (copied < byte_count) {
+        if (reg_now == NULL ||
+            (reg_now->index - 1 + offset) * 2 != copied + addr_start * 2) {
+            /* Handle the exception case of an invalid register quantity or byte count */
+            return modbus_slave_handle_rtu_exception(slave, buf, 0x03, pdu_len);
+        }
+        chunk = (uint16_t) (reg_now->size - offset);
+        if (chunk > (byte_count - copied) / 2) {
+            chunk = (uint16_t) ((byte_count - copied) / 2);
         }
+        if (reg_now->store == NULL && chunk != reg_now->size) {
+            return modbus_slave_handle_rtu_exception(slave, buf, 0x03, pdu_len);
+        }
+        copied += chunk * 2;
+        offset = 0;
+        reg_now = reg_now->next;
+    }
 
-        if (reg_quantity * 2 != byte_count ||
-            reg_now == NULL ||
-            (reg_now->index - 1) * 2 != copied + addr_start * 2 ||
-            byte_count < copied + reg_now->size) {
-            /* Handle the exception case of an invalid register quantity or byte count */
-            return modbus_slave_handle_rtu_exception(slave, buf, 0x03);
+    /* Cached replies of the written range become stale, even if a callback fails halfway */
+    modbus_slave_invalidate(slave, addr_start, reg_quantity);
+
+    /* Perform on_write callback and copy value to register */
+    copied = 0;
+    offset = offset_first;
+    for (reg_now = reg_first; copied < byte_count; reg_now = reg_now->next) {
+        chunk = (uint16_t) (reg_now->size - offset);
+        if (chunk > (byte_count - copied) / 2) {
+            chunk = (uint16_t) ((byte_count - copied) / 2);
         }
 
         /* do registers on write callback */
         if (reg_now->on_write != NULL) {
-            if (reg_now->on_write(reg_now, &buf[copied + 7]) < 0) {
-                /* Handle the internal error case during register writing */
-                return modbus_slave_handle_rtu_exception(slave, buf, 0x04);
-            }
+            MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REG_CB_BEGIN, reg_now->index);
+            rc = reg_now->on_write(reg_now, &buf[copied + 7]);
+            MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REG_CB_END, reg_now->index);
+            if (rc < 0) break;
         }
 
         /* copy buffer to register */
-        memcpy(reg_now->data, &buf[copied + 7], reg_now->size * 2);
-        copied += reg_now->size * 2;
-        reg_now = reg_now->next;
+        if (reg_now->store != NULL) {
+            MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REG_CB_BEGIN, reg_now->index);
+            rc = reg_now->store(reg_now, offset, chunk, &buf[copied + 7]);
+            MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_REG_CB_END, reg_now->index);
+            if (rc < 0) break;
+        } else {
+            memcpy(reg_now->data, &buf[copied + 7], chunk * 2);
+        }
+        if (slave->dirty_map != NULL) {
+            modbus_slave_mark_dirty_map(slave, (uint16_t) (reg_now->index - 1 + offset), chunk);
+        }
+        copied += chunk * 2;
+        offset = 0;
     }
 
-    /* Success */
-    crc16 = modbus_crc16(buf, 6);
-    memcpy(&buf[6], &crc16, 2);
-    if (slave->on_write != NULL) {
-        slave->on_write(slave, buf, 8);
+    if (copied == byte_count) {
+        /* Success */
+        modbus_slave_send_reply(slave, buf, 6, pdu_len);
+        rc = 0;
+    } else {
+        /* Handle the internal error case during register writing */
+        rc = modbus_slave_handle_rtu_exception(slave, buf, 0x04, pdu_len);
     }
 
-    return 0;
+    /* Notify the written range once, including registers written before a failing callback */
+    if (slave->on_write_batch != NULL && copied != 0) {
+        slave->on_write_batch(slave, addr_start, (uint16_t) (copied / 2));
+    }
+
+    return rc;
 }
 
-int modbus_slave_rtu_handle(modbus_slave_t *slave, uint8_t *buf, uint16_t len) {
+/**
+ * @brief Dispatches a validated request to the function code handlers of a Modbus slave.
+ * @param slave Pointer to the Modbus slave.
+ * @param buf Pointer to the request, starting with the unit ID.
+ * @param pdu_len Pointer to store the reply length, or NULL for RTU framing.
+ * @return Returns the result of the handling.
+ */
+static int modbus_slave_dispatch(modbus_slave_t *slave, uint8_t *buf, uint16_t *pdu_len) {
     int rc;
+    switch (buf[1]) {
+        case 0x03: {
+            /*read holding registers*/
+            rc = modbus_slave_handle_rtu_fc03(slave, buf, pdu_len);
+            break;
+        }
+        case 0x10: {
+            /*write multiple registers*/
+            rc = modbus_slave_handle_rtu_fc10(slave, buf, pdu_len);
+            break;
+        }
+        default: {
+            /*function code not supported*/
+            rc = modbus_slave_handle_rtu_exception(slave, buf, 0x01, pdu_len);
+        }
+    }
+    return rc;
+}
+
+/**
+ * @brief Handles one RTU frame for a Modbus slave, see modbus_slave_rtu_handle.
+ * @param slave Pointer to the Modbus slave.
+ * @param buf Pointer to the data buffer.
+ * @param len Length of the data in Bytes.
+ * @return Returns the result of the handling.
+ */
+static int modbus_slave_rtu_handle_frame(modbus_slave_t *slave, uint8_t *buf, uint16_t len) {
     uint16_t crc16;
     /*check data integrity*/
     if (len < 8) return -2;
@@ -325,27 +583,51 @@ int modbus_slave_rtu_handle(modbus_slave_t *slave, uint8_t *buf, uint16_t len) {
     /*check crc*/
     crc16 = modbus_crc16(buf, len - 2);
     if (0 != memcmp(&buf[len - 2], &crc16, 2)) return -2;
+    MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_CRC_CHECKED, buf[1]);
     /*handle on receive callback*/
     if (slave->on_read != NULL) {
         slave->on_read(slave, buf, len);
     }
     /*handle request*/
-    switch (buf[1]) {
-        case 0x03: {
-            /*read holding registers*/
-            rc = modbus_slave_handle_rtu_fc03(slave, buf);
-            break;
-        }
-        case 0x10: {
-            /*write multiple registers*/
-            rc = modbus_slave_handle_rtu_fc10(slave, buf);
-            break;
-        }
-        default: {
-            /*function code not supported*/
-            rc = modbus_slave_handle_rtu_exception(slave, buf, 0x01);
-        }
+    return modbus_slave_dispatch(slave, buf, NULL);
+}
+
+int modbus_slave_rtu_handle(modbus_slave_t *slave, uint8_t *buf, uint16_t len) {
+    int rc;
+    MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_FRAME_BEGIN, len);
+    rc = modbus_slave_rtu_handle_frame(slave, buf, len);
+    MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_FRAME_END, rc);
+    return rc;
+}
+
+/**
+ * @brief Handles one request without RTU framing, see modbus_slave_pdu_handle.
+ * @param slave Pointer to the Modbus slave.
+ * @param buf Pointer to the unit ID followed by the PDU.
+ * @param len Length of the data in Bytes.
+ * @param reply_len Pointer to store the reply length.
+ * @return Returns the result of the handling.
+ */
+static int modbus_slave_pdu_handle_frame(modbus_slave_t *slave, uint8_t *buf, uint16_t len, uint16_t *reply_len) {
+    /*check data integrity*/
+    if (len < 6) return -2;
+    if (buf[1] == MODBUS_WRITE_MULTI_REGISTERS && (len < 7 || len < 7 + buf[6])) return -2;
+    /*check id*/
+    if (buf[0] != slave->id) return -1;
+    /*handle on receive callback*/
+    if (slave->on_read != NULL) {
+        slave->on_read(slave, buf, len);
     }
+    /*handle request*/
+    return modbus_slave_dispatch(slave, buf, reply_len);
+}
+
+int modbus_slave_pdu_handle(modbus_slave_t *slave, uint8_t *buf, uint16_t len, uint16_t *reply_len) {
+    int rc;
+    *reply_len = 0;
+    MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_FRAME_BEGIN, len);
+    rc = modbus_slave_pdu_handle_frame(slave, buf, len, reply_len);
+    MODBUS_TRACE_EVENT(slave, MODBUS_TRACE_FRAME_END, rc);
     return rc;
 }
 
@@ -402,3 +684,196 @@ int modbus_master_write_registers_rtu(
     *len = (uint8_t) (9 + quan * 2);
     return *len;
 }
+
+int modbus_master_device_init(modbus_master_device_t *dev) {
+    dev->srtt = 0;
+    dev->rttvar = 0;
+    dev->min_rto = 20;
+    dev->max_rto = 1000;
+    dev->rto = dev->max_rto;
+    dev->failures = 0;
+    dev->demote_threshold = 3;
+    dev->demoted_interval = 10000;
+    dev->next_poll = 0;
+    dev->state = MODBUS_DEVICE_HEALTHY;
+    dev->rtt_last = 0;
+    dev->rtt_min = 0;
+    dev->rtt_max = 0;
+    dev->responses = 0;
+    dev->timeouts = 0;
+    return 0;
+}
+
+int modbus_master_device_ready(const modbus_master_device_t *dev, uint32_t now) {
+    if (dev->state != MODBUS_DEVICE_DEMOTED) {
+        return 1;
+    }
+    /* Wrap-safe comparison of free-running ticks */
+    return (int32_t) (now - dev->next_poll) >= 0;
+}
+
+uint32_t modbus_master_device_on_response(modbus_master_device_t *dev, uint32_t rtt) {
+    uint32_t delta;
+
+    if (dev->responses == 0) {
+        /* First measurement: SRTT = R, RTTVAR = R / 2 */
+        dev->srtt = rtt << 3;
+        dev->rttvar = rtt << 1;
+        dev->rtt_min = rtt;
+        dev->rtt_max = rtt;
+    } else {
+        /* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R */
+        delta = rtt > (dev->srtt >> 3) ? rtt - (dev->srtt >> 3) : (dev->srtt >> 3) - rtt;
+        dev->rttvar = dev->rttvar - (dev->rttvar >> 2) + delta;
+        dev->srtt = dev->srtt - (dev->srtt >> 3) + rtt;
+        if (rtt < dev->rtt_min) dev->rtt_min = rtt;
+        if (rtt > dev->rtt_max) dev->rtt_max = rtt;
+    }
+    dev->rtt_last = rtt;
+    dev->responses++;
+
+    /* RTO = SRTT + 4 * RTTVAR, the back-off of previous timeouts is dropped */
+    dev->rto = (dev->srtt >> 3) + (dev->rttvar > 0 ? dev->rttvar : 1);
+    if (dev->rto < dev->min_rto) dev->rto = dev->min_rto;
+    if (dev->rto > dev->max_rto) dev->rto = dev->max_rto;
+
+    dev->failures = 0;
+    dev->state = MODBUS_DEVICE_HEALTHY;
+    return dev->rto;
+}
+
+uint32_t modbus_master_device_on_timeout(modbus_master_device_t *dev, uint32_t now) {
+    dev->timeouts++;
+    if (dev->failures < 0xFFFF) dev->failures++;
+
+    /* Exponential back-off */
+    dev->rto = dev->rto > dev->max_rto / 2 ? dev->max_rto : dev->rto * 2;
+
+    /* Circuit breaker: stop a dead device from stalling the line every cycle */
+    if (dev->demote_threshold != 0 && dev->failures >= dev->demote_threshold) {
+        dev->state = MODBUS_DEVICE_DEMOTED;
+        dev->next_poll = now + dev->demoted_interval;
+    }
+    return dev->rto;
+}
+
+int modbus_tag_init(modbus_tag_t *tag) {
+    tag->offset = 0;
+    tag->type = MODBUS_TAG_UINT16;
+    tag->deadband_type = MODBUS_DEADBAND_NONE;
+    tag->deadband = 0.0;
+    tag->value = 0.0;
+    return 0;
+}
+
+int modbus_change_detector_init(modbus_change_detector_t *det) {
+    det->device_id = 0;
+    det->function_code = MODBUS_READ_HOLDING_REGISTERS;
+    det->addr = 0;
+    det->quan = 0;
+    det->image = NULL;
+    det->tags = NULL;
+    det->tag_len = 0;
+    det->integrity_interval = 0;
+    det->polls = 0;
+    det->primed = 0;
+    det->on_change = NULL;
+    return 0;
+}
+
+/**
+ * @brief Decodes a Modbus tag from a register buffer.
+ * @param type Tag type, one of MODBUS_TAG_*.
+ * @param buf Pointer to the first register of the tag.
+ * @return The decoded value.
+ */
+static double modbus_tag_decode(uint8_t type, const uint8_t *buf) {
+    uint32_t u32;
+    float f32;
+    switch (type) {
+        case MODBUS_TAG_INT16:
+            return (double) (int16_t) modbus_reg_to_uint16(buf);
+        case MODBUS_TAG_UINT32:
+        case MODBUS_TAG_INT32:
+        case MODBUS_TAG_FLOAT32: {
+            u32 = ((uint32_t) modbus_reg_to_uint16(buf) << 16) | modbus_reg_to_uint16(&buf[2]);
+            if (type == MODBUS_TAG_UINT32) return (double) u32;
+            if (type == MODBUS_TAG_INT32) return (double) (int32_t) u32;
+            memcpy(&f32, &u32, 4);
+            return (double) f32;
+        }
+        default:
+            return (double) modbus_reg_to_uint16(buf);
+    }
+}
+
+/**
+ * @brief Checks whether a new tag value leaves the deadband around the last reported value.
+ * @param tag Pointer to the Modbus tag.
+ * @param value The new decoded value.
+ * @return 1 if the value should be reported, 0 otherwise.
+ */
+static int modbus_tag_exceeds_deadband(const modbus_tag_t *tag, double value) {
+    double delta = value - tag->value, limit;
+    /* NaN fails every comparison, so entering or leaving NaN is reported explicitly */
+    if ((value != value) != (tag->value != tag->value)) {
+        return 1;
+    }
+    if (delta < 0) delta = -delta;
+    switch (tag->deadband_type) {
+        case MODBUS_DEADBAND_ABSOLUTE:
+            limit = tag->deadband;
+            break;
+        case MODBUS_DEADBAND_PERCENT:
+            limit = (tag->value < 0 ? -tag->value : tag->value) * tag->deadband / 100.0;
+            break;
+        default:
+            limit = 0;
+    }
+    return delta > limit;
+}
+
+int modbus_master_detect_changes(modbus_change_detector_t *det, const uint8_t *buf, uint16_t len) {
+    int reported = 0, full;
+    uint16_t i, crc16, byte_count = det->quan * 2, width;
+    const uint8_t *data = &buf[3];
+    modbus_tag_t *tag;
+    double value;
+
+    /* Check data integrity */
+    if (len < 5) return -2;
+    /* Check that the ADU answers this request */
+    if (buf[0] != det->device_id || buf[1] != det->function_code) return -1;
+    if (buf[2] != byte_count || len != byte_count + 5) return -2;
+    crc16 = modbus_crc16(buf, len - 2);
+    if (0 != memcmp(&buf[len - 2], &crc16, 2)) return -2;
+
+    /* Decide between report-by-exception and a full integrity report */
+    det->polls++;
+    full = !det->primed || (det->integrity_interval != 0 && det->polls >= det->integrity_interval);
+    if (full) {
+        det->polls = 0;
+    } else if (0 == memcmp(det->image, data, byte_count)) {
+        /* Nothing changed since the last poll */
+        return 0;
+    }
+
+    for (i = 0; i < det->tag_len; i++) {
+        tag = &det->tags[i];
+        width = (tag->type == MODBUS_TAG_UINT16 || tag->type == MODBUS_TAG_INT16) ? 2 : 4;
+        if (tag->offset * 2 + width > byte_count) continue;
+        /* Skip the decode when the raw registers did not change */
+        if (!full && 0 == memcmp(&det->image[tag->offset * 2], &data[tag->offset * 2], width)) continue;
+        value = modbus_tag_decode(tag->type, &data[tag->offset * 2]);
+        if (!full && !modbus_tag_exceeds_deadband(tag, value)) continue;
+        if (det->on_change != NULL) {
+            det->on_change(det, tag, value);
+        }
+        tag->value = value;
+        reported++;
+    }
+
+    memcpy(det->image, data, byte_count);
+    det->primed = 1;
+    return reported;
+}
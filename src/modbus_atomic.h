@@ -0,0 +1,50 @@
+#ifndef MODBUS_ATOMIC_H
+#define MODBUS_ATOMIC_H
+
+/*
+ * Minimal atomic operations for state shared with another thread or process.
+ * LOAD and STORE take 8 or 32-bit objects, OR and XCHG 8-bit objects and CAS
+ * 32-bit objects. CAS is nonzero if *ptr held expected and now holds desired.
+ * GCC and Clang builtins and MSVC interlocked intrinsics are supported. Other
+ * compilers have to define MODBUS_ATOMIC_PLAIN to accept plain accesses, which
+ * are only safe when the caller serializes access (e.g. a single core with the
+ * competing interrupt disabled).
+ */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MODBUS_ATOMIC_LOAD(ptr)             __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define MODBUS_ATOMIC_STORE(ptr, val)       __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define MODBUS_ATOMIC_OR(ptr, val)          ((void) __atomic_fetch_or((ptr), (val), __ATOMIC_RELEASE))
+#define MODBUS_ATOMIC_XCHG(ptr, val, out)   ((out) = __atomic_exchange_n((ptr), (val), __ATOMIC_ACQ_REL))
+#define MODBUS_ATOMIC_CAS(ptr, expected, desired) \
+    __atomic_compare_exchange_n((ptr), &(expected), (desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define MODBUS_ATOMIC_FENCE()               __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define MODBUS_ATOMIC_RELEASE_FENCE()       __atomic_thread_fence(__ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <windows.h>
+/* Interlocked operations are full barriers */
+#define MODBUS_ATOMIC_LOAD(ptr) \
+    (sizeof(*(ptr)) == 1 ? (uint32_t) (uint8_t) _InterlockedOr8((volatile char *) (ptr), 0) \
+                         : (uint32_t) _InterlockedOr((volatile long *) (ptr), 0))
+#define MODBUS_ATOMIC_STORE(ptr, val) \
+    (sizeof(*(ptr)) == 1 ? (void) _InterlockedExchange8((volatile char *) (ptr), (char) (val)) \
+                         : (void) _InterlockedExchange((volatile long *) (ptr), (long) (val)))
+#define MODBUS_ATOMIC_OR(ptr, val)          ((void) _InterlockedOr8((volatile char *) (ptr), (char) (val)))
+#define MODBUS_ATOMIC_XCHG(ptr, val, out)   ((out) = (uint8_t) _InterlockedExchange8((volatile char *) (ptr), (char) (val)))
+#define MODBUS_ATOMIC_CAS(ptr, expected, desired) \
+    (_InterlockedCompareExchange((volatile long *) (ptr), (long) (desired), (long) (expected)) == (long) (expected))
+#define MODBUS_ATOMIC_FENCE()               MemoryBarrier()
+#define MODBUS_ATOMIC_RELEASE_FENCE()       MemoryBarrier()
+#elif defined(MODBUS_ATOMIC_PLAIN)
+#define MODBUS_ATOMIC_LOAD(ptr)             (*(ptr))
+#define MODBUS_ATOMIC_STORE(ptr, val)       (*(ptr) = (val))
+#define MODBUS_ATOMIC_OR(ptr, val)          ((void) (*(ptr) |= (val)))
+#define MODBUS_ATOMIC_XCHG(ptr, val, out)   ((out) = *(ptr), *(ptr) = (val))
+#define MODBUS_ATOMIC_CAS(ptr, expected, desired) (*(ptr) == (expected) ? (*(ptr) = (desired), 1) : 0)
+#define MODBUS_ATOMIC_FENCE()               ((void) 0)
+#define MODBUS_ATOMIC_RELEASE_FENCE()       ((void) 0)
+#else
+#error "No atomic operations for this compiler, define MODBUS_ATOMIC_PLAIN if access is serialized"
+#endif
+
+#endif /*MODBUS_ATOMIC_H*/
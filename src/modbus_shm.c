@@ -0,0 +1,251 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "modbus_shm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "modbus_atomic.h"
+
+/**
+ * @brief Returns the sequence counter of the block whose data starts at the given pointer.
+ * @param data Pointer to the register data of a block.
+ * @return Pointer to the sequence counter.
+ */
+static uint32_t *modbus_shm_block_seq(uint8_t *data) {
+    return (uint32_t *) (void *) (data - sizeof(uint32_t));
+}
+
+/**
+ * @brief Maps a shared memory file descriptor.
+ * @param shm Pointer to the handle.
+ * @param fd File descriptor.
+ * @param size Size of the mapping in Bytes.
+ * @return Returns 0 on success, or a negative value if an error occurred.
+ */
+static int modbus_shm_map(modbus_shm_t *shm, int fd, size_t size) {
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    shm->header = (modbus_shm_header_t *) addr;
+    shm->blocks = (uint8_t *) addr + sizeof(modbus_shm_header_t);
+    shm->size = size;
+    return 0;
+}
+
+int modbus_shm_create(modbus_shm_t *shm, const char *name, uint16_t reg_count, uint16_t block_size) {
+    int fd;
+    uint16_t block_count;
+    size_t block_stride, size;
+
+    if (reg_count == 0 || block_size == 0 || block_size > reg_count) {
+        return -1;
+    }
+    block_count = (uint16_t) ((reg_count + block_size - 1) / block_size);
+    /* Keep every sequence counter 4-byte aligned */
+    block_stride = (sizeof(uint32_t) + (size_t) block_size * 2 + 3) & ~(size_t) 3;
+    if (block_stride > 0xFFFF) {
+        /* The stride does not fit into the header */
+        return -1;
+    }
+    size = sizeof(modbus_shm_header_t) + (size_t) block_count * block_stride;
+
+    fd = shm_open(name, O_CREAT | O_RDWR, 0660);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, (off_t) size) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (modbus_shm_map(shm, fd, size) != 0) {
+        return -1;
+    }
+
+    memset(shm->header, 0, size);
+    shm->header->version = MODBUS_SHM_VERSION;
+    shm->header->header_size = sizeof(modbus_shm_header_t);
+    shm->header->reg_count = reg_count;
+    shm->header->block_size = block_size;
+    shm->header->block_count = block_count;
+    shm->header->block_stride = (uint16_t) block_stride;
+    /* Publish the layout */
+    MODBUS_ATOMIC_STORE(&shm->header->magic, (uint32_t) MODBUS_SHM_MAGIC);
+    return 0;
+}
+
+int modbus_shm_open(modbus_shm_t *shm, const char *name) {
+    int fd;
+    struct stat st;
+    modbus_shm_header_t *header;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(modbus_shm_header_t)) {
+        close(fd);
+        return -1;
+    }
+    if (modbus_shm_map(shm, fd, (size_t) st.st_size) != 0) {
+        return -1;
+    }
+
+    /* Validate the layout */
+    header = shm->header;
+    if (MODBUS_ATOMIC_LOAD(&header->magic) != MODBUS_SHM_MAGIC ||
+        header->version != MODBUS_SHM_VERSION ||
+        header->header_size != sizeof(modbus_shm_header_t) ||
+        header->block_size == 0 ||
+        header->block_stride % sizeof(uint32_t) != 0 ||
+        header->block_stride < sizeof(uint32_t) + (size_t) header->block_size * 2 ||
+        header->block_count != (header->reg_count + header->block_size - 1) / header->block_size ||
+        sizeof(modbus_shm_header_t) + (size_t) header->block_count * header->block_stride > shm->size) {
+        modbus_shm_close(shm);
+        return -1;
+    }
+    return 0;
+}
+
+int modbus_shm_close(modbus_shm_t *shm) {
+    int rc = munmap(shm->header, shm->size);
+    shm->header = NULL;
+    shm->blocks = NULL;
+    shm->size = 0;
+    return rc == 0 ? 0 : -1;
+}
+
+int modbus_shm_unlink(const char *name) {
+    return shm_unlink(name) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Copies registers into one block between two sequence counter increments.
+ *
+ * The writer takes the block by swapping the counter from even to odd, so
+ * several writers of the same block exclude each other.
+ *
+ * @param data Pointer to the register data of the block.
+ * @param offset Offset inside the block in Bytes.
+ * @param regs Registers to be copied.
+ * @param len Length in Bytes.
+ * @return Returns 0 on success, or a negative value if the block stayed locked.
+ */
+static int modbus_shm_block_write(uint8_t *data, uint16_t offset, const uint8_t *regs, uint16_t len) {
+    uint32_t *seq = modbus_shm_block_seq(data), now;
+    int spin;
+    for (spin = 0; spin < MODBUS_SHM_SPIN_LIMIT; spin++) {
+        now = MODBUS_ATOMIC_LOAD(seq);
+        if (now & 1) continue;
+        if (!MODBUS_ATOMIC_CAS(seq, now, now + 1)) continue;
+        MODBUS_ATOMIC_FENCE();
+        memcpy(data + offset, regs, len);
+        MODBUS_ATOMIC_STORE(seq, now + 2);
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Copies registers out of one block, retrying while a writer updates it.
+ * @param data Pointer to the register data of the block.
+ * @param offset Offset inside the block in Bytes.
+ * @param regs Buffer to store the registers.
+ * @param len Length in Bytes.
+ * @return Returns 0 on success, or a negative value if the block stayed locked.
+ */
+static int modbus_shm_block_read(uint8_t *data, uint16_t offset, uint8_t *regs, uint16_t len) {
+    uint32_t *seq = modbus_shm_block_seq(data), before;
+    int spin;
+    for (spin = 0; spin < MODBUS_SHM_SPIN_LIMIT; spin++) {
+        before = MODBUS_ATOMIC_LOAD(seq);
+        if (before & 1) continue;
+        memcpy(regs, data + offset, len);
+        MODBUS_ATOMIC_FENCE();
+        if (MODBUS_ATOMIC_LOAD(seq) == before) return 0;
+    }
+    return -1;
+}
+
+int modbus_shm_write(modbus_shm_t *shm, uint16_t addr, const uint8_t *regs, uint16_t quan) {
+    modbus_shm_header_t *header = shm->header;
+    uint16_t block, offset, chunk;
+    if ((uint32_t) addr + quan > header->reg_count) {
+        return -1;
+    }
+    while (quan > 0) {
+        block = addr / header->block_size;
+        offset = addr % header->block_size;
+        chunk = header->block_size - offset;
+        if (chunk > quan) chunk = quan;
+        if (modbus_shm_block_write(
+                shm->blocks + (size_t) block * header->block_stride + sizeof(uint32_t),
+                (uint16_t) (offset * 2), regs, (uint16_t) (chunk * 2)) != 0) {
+            return -1;
+        }
+        addr += chunk;
+        regs += chunk * 2;
+        quan -= chunk;
+    }
+    return 0;
+}
+
+int modbus_shm_read(modbus_shm_t *shm, uint16_t addr, uint8_t *regs, uint16_t quan) {
+    modbus_shm_header_t *header = shm->header;
+    uint16_t block, offset, chunk;
+    if ((uint32_t) addr + quan > header->reg_count) {
+        return -1;
+    }
+    while (quan > 0) {
+        block = addr / header->block_size;
+        offset = addr % header->block_size;
+        chunk = header->block_size - offset;
+        if (chunk > quan) chunk = quan;
+        if (modbus_shm_block_read(
+                shm->blocks + (size_t) block * header->block_stride + sizeof(uint32_t),
+                (uint16_t) (offset * 2), regs, (uint16_t) (chunk * 2)) != 0) {
+            return -1;
+        }
+        addr += chunk;
+        regs += chunk * 2;
+        quan -= chunk;
+    }
+    return 0;
+}
+
+/**
+ * @brief Register load callback copying a consistent snapshot of the block range into the reply.
+ */
+static int modbus_shm_load(modbus_register_t *reg, uint16_t offset, uint16_t quan, uint8_t *buf) {
+    return modbus_shm_block_read(reg->data, (uint16_t) (offset * 2), buf, (uint16_t) (quan * 2));
+}
+
+/**
+ * @brief Register store callback writing the value through the block sequence counter.
+ *
+ * The slave skips its own copy for nodes with a store callback, so this is the
+ * only write into the block.
+ */
+static int modbus_shm_store(modbus_register_t *reg, uint16_t offset, uint16_t quan, uint8_t *buf) {
+    return modbus_shm_block_write(reg->data, (uint16_t) (offset * 2), buf, (uint16_t) (quan * 2));
+}
+
+int modbus_shm_register_map(modbus_shm_t *shm, modbus_slave_t *slave, modbus_register_t *regs, uint16_t index) {
+    modbus_shm_header_t *header = shm->header;
+    uint16_t block, remaining = header->reg_count;
+    for (block = 0; block < header->block_count; block++) {
+        modbus_register_init(&regs[block]);
+        regs[block].index = (uint16_t) (index + block * header->block_size);
+        regs[block].size = remaining < header->block_size ? remaining : header->block_size;
+        regs[block].data = shm->blocks + (size_t) block * header->block_stride + sizeof(uint32_t);
+        regs[block].load = modbus_shm_load;
+        regs[block].store = modbus_shm_store;
+        remaining -= regs[block].size;
+        modbus_slave_add_register(slave, &regs[block]);
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include "modbus_sim.h"
+
+/**
+ * @brief Returns the simulator a pointer to one of its members belongs to.
+ */
+#define MODBUS_SIM_OF(ptr, member) ((modbus_sim_t *) (void *) ((uint8_t *) (ptr) - offsetof(modbus_sim_t, member)))
+
+/**
+ * @brief Register load callback reading the current device.
+ */
+static int modbus_sim_load(modbus_register_t *reg, uint16_t offset, uint16_t quan, uint8_t *buf) {
+    modbus_sim_t *sim = MODBUS_SIM_OF(reg, reg);
+    return modbus_sim_read(sim, sim->device, offset, quan, buf);
+}
+
+/**
+ * @brief Register store callback writing the current device, failing when the page pool is exhausted.
+ */
+static int modbus_sim_store(modbus_register_t *reg, uint16_t offset, uint16_t quan, uint8_t *buf) {
+    modbus_sim_t *sim = MODBUS_SIM_OF(reg, reg);
+    return modbus_sim_write(sim, sim->device, offset, quan, buf) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Slave reply callback handing the RTU reply of the current device to on_write.
+ */
+static int modbus_sim_on_reply(modbus_slave_t *slave, uint8_t *buf, uint16_t len) {
+    modbus_sim_t *sim = MODBUS_SIM_OF(slave, slave);
+    if (sim->on_write == NULL) {
+        return 0;
+    }
+    return sim->on_write(sim, sim->device, buf, len);
+}
+
+int modbus_sim_init(modbus_sim_t *sim, const modbus_sim_template_t *tmpl,
+                    modbus_sim_device_t *devices, uint16_t device_len,
+                    modbus_sim_page_t *pages, uint16_t page_len) {
+    uint16_t i;
+    if (page_len == MODBUS_SIM_NO_PAGE) {
+        return -1;
+    }
+    sim->tmpl = tmpl;
+    sim->devices = devices;
+    sim->device_len = device_len;
+    sim->pages = pages;
+    sim->page_len = page_len;
+    sim->now = 0;
+    sim->on_write = NULL;
+    sim->device = 0;
+    modbus_slave_init(&sim->slave);
+    sim->slave.on_write = modbus_sim_on_reply;
+    modbus_register_init(&sim->reg);
+    sim->reg.index = 1;
+    sim->reg.size = tmpl->reg_count;
+    sim->reg.load = modbus_sim_load;
+    sim->reg.store = modbus_sim_store;
+    modbus_slave_add_register(&sim->slave, &sim->reg);
+    for (i = 0; i < device_len; i++) {
+        devices[i].pages = MODBUS_SIM_NO_PAGE;
+    }
+    /* Chain all pages into the free list */
+    for (i = 0; i < page_len; i++) {
+        pages[i].next = (uint16_t) (i + 1 < page_len ? i + 1 : MODBUS_SIM_NO_PAGE);
+    }
+    sim->free_page = page_len > 0 ? 0 : MODBUS_SIM_NO_PAGE;
+    sim->free_len = page_len;
+    return 0;
+}
+
+int modbus_sim_reset(modbus_sim_t *sim, uint16_t device) {
+    uint16_t page, next;
+    if (device >= sim->device_len) {
+        return -1;
+    }
+    for (page = sim->devices[device].pages; page != MODBUS_SIM_NO_PAGE; page = next) {
+        next = sim->pages[page].next;
+        sim->pages[page].next = sim->free_page;
+        sim->free_page = page;
+        sim->free_len++;
+    }
+    sim->devices[device].pages = MODBUS_SIM_NO_PAGE;
+    return 0;
+}
+
+/**
+ * @brief Finds the written page of a simulated device holding the given base address.
+ * @param sim Pointer to the Modbus simulator.
+ * @param device Index of the simulated device.
+ * @param base Address of the first register in the page.
+ * @return Index of the page, or MODBUS_SIM_NO_PAGE if the page was never written.
+ */
+static uint16_t modbus_sim_find_page(modbus_sim_t *sim, uint16_t device, uint16_t base) {
+    uint16_t page;
+    for (page = sim->devices[device].pages; page != MODBUS_SIM_NO_PAGE; page = sim->pages[page].next) {
+        if (sim->pages[page].base == base) break;
+    }
+    return page;
+}
+
+/**
+ * @brief Computes the current value of a generated register.
+ * @param sim Pointer to the Modbus simulator.
+ * @param device Index of the simulated device, used as phase offset.
+ * @param wave Pointer to the waveform.
+ * @return The register value.
+ */
+static uint16_t modbus_sim_wave_value(modbus_sim_t *sim, uint16_t device, const modbus_sim_wave_t *wave) {
+    uint32_t phase, span = (uint32_t) wave->max - wave->min, half;
+    if (wave->period == 0) {
+        return wave->min;
+    }
+    /* Spread the devices over the period so that they do not move in lockstep */
+    phase = (sim->now + (uint32_t) device * 37) % wave->period;
+    half = wave->period / 2;
+    switch (wave->shape) {
+        case MODBUS_SIM_WAVE_TRIANGLE:
+            if (half == 0) return wave->min;
+            /* The falling part is one tick longer for odd periods */
+            if (phase >= half) {
+                return (uint16_t) (wave->min + span * (wave->period - phase) / (wave->period - half));
+            }
+            return (uint16_t) (wave->min + span * phase / half);
+        case MODBUS_SIM_WAVE_SQUARE:
+            return phase < half ? wave->min : wave->max;
+        default:
+            return (uint16_t) (wave->min + span * phase / wave->period);
+    }
+}
+
+int modbus_sim_read(modbus_sim_t *sim, uint16_t device, uint16_t addr, uint16_t quan, uint8_t *regs) {
+    const modbus_sim_template_t *tmpl = sim->tmpl;
+    uint32_t end = (uint32_t) addr + quan, from, to;
+    uint16_t page, i;
+    modbus_sim_page_t *p;
+
+    if (device >= sim->device_len || quan == 0 || end > tmpl->reg_count) {
+        return -1;
+    }
+
+    /* Template first, then the pages this device has written */
+    memcpy(regs, &tmpl->image[addr * 2], quan * 2);
+    for (page = sim->devices[device].pages; page != MODBUS_SIM_NO_PAGE; page = p->next) {
+        p = &sim->pages[page];
+        from = p->base > addr ? p->base : addr;
+        to = (uint32_t) p->base + MODBUS_SIM_PAGE_SIZE < end ? (uint32_t) p->base + MODBUS_SIM_PAGE_SIZE : end;
+        if (from < to) {
+            memcpy(&regs[(from - addr) * 2], &p->data[(from - p->base) * 2], (to - from) * 2);
+        }
+    }
+
+    /* Generated registers are computed lazily, only when they are read */
+    for (i = 0; i < tmpl->wave_len; i++) {
+        if (tmpl->waves[i].addr >= addr && tmpl->waves[i].addr < end) {
+            modbus_uint16_to_reg(modbus_sim_wave_value(sim, device, &tmpl->waves[i]),
+                                 &regs[(tmpl->waves[i].addr - addr) * 2]);
+        }
+    }
+    return 0;
+}
+
+int modbus_sim_write(modbus_sim_t *sim, uint16_t device, uint16_t addr, uint16_t quan, const uint8_t *regs) {
+    const modbus_sim_template_t *tmpl = sim->tmpl;
+    uint32_t end = (uint32_t) addr + quan, base, from, to, count;
+    uint16_t page, missing = 0;
+    modbus_sim_page_t *p;
+
+    if (device >= sim->device_len || quan == 0 || end > tmpl->reg_count) {
+        return -1;
+    }
+
+    /* Make sure the whole write fits before copying any page */
+    for (base = addr - addr % MODBUS_SIM_PAGE_SIZE; base < end; base += MODBUS_SIM_PAGE_SIZE) {
+        if (modbus_sim_find_page(sim, device, (uint16_t) base) == MODBUS_SIM_NO_PAGE) missing++;
+    }
+    if (missing > sim->free_len) {
+        return -2;
+    }
+
+    for (base = addr - addr % MODBUS_SIM_PAGE_SIZE; base < end; base += MODBUS_SIM_PAGE_SIZE) {
+        page = modbus_sim_find_page(sim, device, (uint16_t) base);
+        if (page == MODBUS_SIM_NO_PAGE) {
+            /* Copy on write: take a free page and fill it from the template */
+            page = sim->free_page;
+            p = &sim->pages[page];
+            sim->free_page = p->next;
+            sim->free_len--;
+            p->base = (uint16_t) base;
+            count = tmpl->reg_count - base < MODBUS_SIM_PAGE_SIZE ? tmpl->reg_count - base : MODBUS_SIM_PAGE_SIZE;
+            memcpy(p->data, &tmpl->image[base * 2], count * 2);
+            p->next = sim->devices[device].pages;
+            sim->devices[device].pages = page;
+        }
+        p = &sim->pages[page];
+        from = base > addr ? base : addr;
+        to = base + MODBUS_SIM_PAGE_SIZE < end ? base + MODBUS_SIM_PAGE_SIZE : end;
+        memcpy(&p->data[(from - base) * 2], &regs[(from - addr) * 2], (to - from) * 2);
+    }
+    return 0;
+}
+
+int modbus_sim_rtu_handle(modbus_sim_t *sim, uint16_t device, uint8_t *buf, uint16_t len) {
+    if (device >= sim->device_len) return -1;
+    if (len < 8) return -2;
+    sim->device = device;
+    sim->slave.id = buf[0];
+    return modbus_slave_rtu_handle(&sim->slave, buf, len);
+}
+
+int modbus_sim_pdu_handle(modbus_sim_t *sim, uint16_t base, uint8_t *buf, uint16_t len, uint16_t *reply_len) {
+    *reply_len = 0;
+    if (len < 1) return -2;
+    if (buf[0] == 0 || buf[0] > 247 || (uint32_t) base + buf[0] - 1 >= sim->device_len) return -1;
+    sim->device = (uint16_t) (base + buf[0] - 1);
+    sim->slave.id = buf[0];
+    return modbus_slave_pdu_handle(&sim->slave, buf, len, reply_len);
+}
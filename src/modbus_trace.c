@@ -0,0 +1,96 @@
+#include "modbus_trace.h"
+
+#include <string.h>
+
+#include "modbus_atomic.h"
+
+int modbus_trace_init(modbus_trace_t *trace, modbus_trace_event_t *events, uint32_t capacity,
+                      modbus_trace_clock_cb clock) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+    trace->events = events;
+    trace->capacity = capacity;
+    trace->head = 0;
+    trace->clock = clock;
+    return 0;
+}
+
+void modbus_trace_record(modbus_trace_t *trace, uint16_t type, uint16_t arg) {
+    uint32_t head = trace->head;
+    modbus_trace_event_t *event = &trace->events[head & (trace->capacity - 1)];
+    /* Keep the slot writes behind the previous head update, like a seqlock writer */
+    MODBUS_ATOMIC_RELEASE_FENCE();
+    event->time = trace->clock != NULL ? trace->clock() : 0;
+    event->type = type;
+    event->arg = arg;
+    /* Publish the event */
+    MODBUS_ATOMIC_STORE(&trace->head, head + 1);
+}
+
+uint32_t modbus_trace_dump(modbus_trace_t *trace, modbus_trace_event_t *out, uint32_t max) {
+    uint32_t head, first, safe, len, i;
+
+    head = MODBUS_ATOMIC_LOAD(&trace->head);
+    len = head < trace->capacity ? head : trace->capacity;
+    if (len > max) len = max;
+    first = head - len;
+    for (i = 0; i < len; i++) {
+        out[i] = trace->events[(first + i) & (trace->capacity - 1)];
+    }
+    MODBUS_ATOMIC_FENCE();
+
+    /* The producer may have overwritten the oldest events, and may be writing the next slot */
+    head = MODBUS_ATOMIC_LOAD(&trace->head);
+    safe = head + 1 - trace->capacity;
+    if (head + 1 > trace->capacity && (int32_t) (safe - first) > 0) {
+        i = safe - first;
+        if (i > len) i = len;
+        memmove(out, &out[i], (len - i) * sizeof(modbus_trace_event_t));
+        len -= i;
+    }
+    return len;
+}
+
+/**
+ * @brief Returns the Chrome trace phase and name of an event type.
+ * @param type Event type, one of MODBUS_TRACE_*.
+ * @param name Pointer to store the event name.
+ * @return The phase character.
+ */
+static char modbus_trace_phase(uint16_t type, const char **name) {
+    switch (type) {
+        case MODBUS_TRACE_FRAME_BEGIN: *name = "frame"; return 'B';
+        case MODBUS_TRACE_FRAME_END: *name = "frame"; return 'E';
+        case MODBUS_TRACE_CRC_CHECKED: *name = "crc"; return 'i';
+        case MODBUS_TRACE_LOOKUP_DONE: *name = "lookup"; return 'i';
+        case MODBUS_TRACE_REG_CB_BEGIN: *name = "register"; return 'B';
+        case MODBUS_TRACE_REG_CB_END: *name = "register"; return 'E';
+        case MODBUS_TRACE_REPLY_BEGIN: *name = "reply"; return 'B';
+        case MODBUS_TRACE_REPLY_END: *name = "reply"; return 'E';
+        default: *name = "unknown"; return 'i';
+    }
+}
+
+int modbus_trace_write_chrome_json(FILE *fp, const modbus_trace_event_t *events, uint32_t len,
+                                   double ticks_per_us, int tid) {
+    uint32_t i;
+    double ts = 0.0;
+    const char *name;
+    char phase;
+
+    if (fprintf(fp, "{\"traceEvents\":[") < 0) return -1;
+    for (i = 0; i < len; i++) {
+        /* Accumulate deltas so that a wrapping clock stays monotonic */
+        if (i > 0) ts += (double) (uint32_t) (events[i].time - events[i - 1].time) / ticks_per_us;
+        phase = modbus_trace_phase(events[i].type, &name);
+        if (fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d%s,"
+                        "\"args\":{\"arg\":%u}}",
+                    i > 0 ? "," : "", name, phase, ts, tid, phase == 'i' ? ",\"s\":\"t\"" : "",
+                    (unsigned) events[i].arg) < 0) {
+            return -1;
+        }
+    }
+    if (fprintf(fp, "\n]}\n") < 0) return -1;
+    return 0;
+}
@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+
+#include "modbus_udp.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/uio.h>
+
+int modbus_udp_init(modbus_udp_t *udp, int fd, modbus_slave_t *slave, uint8_t *rx, size_t rx_size) {
+#ifdef UDP_GRO
+    int on = 1;
+#endif
+    if (rx_size / MODBUS_UDP_BATCH < MODBUS_UDP_ADU_SIZE) {
+        return -1;
+    }
+    udp->fd = fd;
+    udp->slave = slave;
+    udp->sim = NULL;
+    udp->sim_base = 0;
+    udp->rx = rx;
+    udp->rx_slot_size = rx_size / MODBUS_UDP_BATCH;
+    udp->gro = 0;
+    udp->tx_len = 0;
+    udp->requests = 0;
+    udp->recv_calls = 0;
+    udp->send_calls = 0;
+#ifdef UDP_GRO
+    /* A coalesced datagram is truncated if it does not fit, so only enable GRO with full-size slots */
+    if (udp->rx_slot_size >= MODBUS_UDP_GRO_SIZE &&
+        setsockopt(fd, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0) {
+        udp->gro = 1;
+    }
+#endif
+    return 0;
+}
+
+int modbus_udp_init_sim(modbus_udp_t *udp, int fd, modbus_sim_t *sim, uint16_t base, uint8_t *rx, size_t rx_size) {
+    if (modbus_udp_init(udp, fd, NULL, rx, rx_size) != 0) {
+        return -1;
+    }
+    udp->sim = sim;
+    udp->sim_base = base;
+    return 0;
+}
+
+/**
+ * @brief Sends all pending replies of the transmit ring with as few sendmmsg calls as possible.
+ *
+ * Replies the socket does not accept are dropped, like lost datagrams.
+ *
+ * @param udp Pointer to the transport.
+ */
+static void modbus_udp_flush(modbus_udp_t *udp) {
+    struct mmsghdr msgs[MODBUS_UDP_BATCH];
+    struct iovec iov[MODBUS_UDP_BATCH];
+    modbus_udp_slot_t *slot;
+    uint16_t i, sent = 0;
+    int rc;
+
+    for (i = 0; i < udp->tx_len; i++) {
+        slot = &udp->tx[i];
+        iov[i].iov_base = slot->buf;
+        iov[i].iov_len = slot->len;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = &slot->addr;
+        msgs[i].msg_hdr.msg_namelen = slot->addr_len;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (sent < udp->tx_len) {
+        rc = sendmmsg(udp->fd, &msgs[sent], udp->tx_len - sent, 0);
+        udp->send_calls++;
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) break;
+        sent += (uint16_t) rc;
+    }
+    udp->tx_len = 0;
+}
+
+/**
+ * @brief Parses the MBAP header of a request and queues the reply of the slave or simulator.
+ * @param udp Pointer to the transport.
+ * @param adu Pointer to the request ADU.
+ * @param len Length of the request in Bytes.
+ * @param addr Peer address.
+ * @param addr_len Length of the peer address.
+ * @return Returns 1 if a reply was queued, 0 if the request was dropped.
+ */
+static int modbus_udp_handle(modbus_udp_t *udp, const uint8_t *adu, size_t len,
+                             const struct sockaddr_storage *addr, socklen_t addr_len) {
+    modbus_udp_slot_t *slot;
+    uint16_t reply_len;
+    int rc;
+
+    /* MBAP: transaction ID, protocol ID 0, length of the unit ID and PDU, unit ID */
+    if (len < 8 || len > MODBUS_UDP_ADU_SIZE || adu[2] != 0 || adu[3] != 0 ||
+        modbus_reg_to_uint16(&adu[4]) != len - 6) {
+        return 0;
+    }
+
+    if (udp->tx_len == MODBUS_UDP_BATCH) {
+        modbus_udp_flush(udp);
+    }
+    slot = &udp->tx[udp->tx_len];
+
+    /* The reply is built in place behind the copied MBAP header */
+    memcpy(slot->buf, adu, len);
+    if (udp->sim != NULL) {
+        rc = modbus_sim_pdu_handle(udp->sim, udp->sim_base, &slot->buf[6], (uint16_t) (len - 6), &reply_len);
+    } else {
+        rc = modbus_slave_pdu_handle(udp->slave, &slot->buf[6], (uint16_t) (len - 6), &reply_len);
+    }
+    if (rc < 0 || reply_len == 0) {
+        return 0;
+    }
+    modbus_uint16_to_reg(reply_len, &slot->buf[4]);
+    slot->len = (uint16_t) (6 + reply_len);
+    memcpy(&slot->addr, addr, addr_len);
+    slot->addr_len = addr_len;
+    udp->tx_len++;
+    udp->requests++;
+    return 1;
+}
+
+int modbus_udp_poll(modbus_udp_t *udp) {
+    struct mmsghdr msgs[MODBUS_UDP_BATCH];
+    struct iovec iov[MODBUS_UDP_BATCH];
+#ifdef UDP_GRO
+    char control[MODBUS_UDP_BATCH][CMSG_SPACE(sizeof(int))];
+    struct cmsghdr *cmsg;
+    int gso_size;
+#endif
+    uint8_t *data;
+    size_t len, seg, off;
+    int i, n, handled = 0;
+
+    for (i = 0; i < MODBUS_UDP_BATCH; i++) {
+        iov[i].iov_base = udp->rx + (size_t) i * udp->rx_slot_size;
+        iov[i].iov_len = udp->rx_slot_size;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = &udp->rx_addr[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(udp->rx_addr[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+#ifdef UDP_GRO
+        if (udp->gro) {
+            msgs[i].msg_hdr.msg_control = control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+#endif
+    }
+
+    /* Wait for the first datagram, then take whatever else is queued */
+    do {
+        n = recvmmsg(udp->fd, msgs, MODBUS_UDP_BATCH, MSG_WAITFORONE, NULL);
+        udp->recv_calls++;
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        data = iov[i].iov_base;
+        len = msgs[i].msg_len;
+        seg = len;
+#ifdef UDP_GRO
+        /* A coalesced datagram carries requests of gso_size Bytes, the last one may be shorter */
+        for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); udp->gro && cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+            if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+                memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+                if (gso_size > 0) seg = (size_t) gso_size;
+            }
+        }
+#endif
+        for (off = 0; off < len; off += seg) {
+            handled += modbus_udp_handle(udp, &data[off], len - off < seg ? len - off : seg,
+                                         &udp->rx_addr[i], msgs[i].msg_hdr.msg_namelen);
+        }
+    }
+
+    modbus_udp_flush(udp);
+    return handled;
+}
+
+int modbus_udp_poll_one(modbus_udp_t *udp) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    modbus_udp_slot_t *slot;
+    ssize_t len;
+
+    do {
+        len = recvfrom(udp->fd, udp->rx, udp->rx_slot_size, 0, (struct sockaddr *) &addr, &addr_len);
+        udp->recv_calls++;
+    } while (len < 0 && errno == EINTR);
+    if (len < 0) {
+        return -1;
+    }
+    if (!modbus_udp_handle(udp, udp->rx, (size_t) len, &addr, addr_len)) {
+        return 0;
+    }
+
+    slot = &udp->tx[--udp->tx_len];
+    sendto(udp->fd, slot->buf, slot->len, 0, (struct sockaddr *) &slot->addr, slot->addr_len);
+    udp->send_calls++;
+    return 1;
+}
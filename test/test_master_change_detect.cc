@@ -0,0 +1,154 @@
+#include "modbus.h"
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+static int changes = 0;
+static double last_value = 0.0;
+
+int on_tag_change(modbus_change_detector_t *det, modbus_tag_t *tag, double value) {
+    (void) det;
+    (void) tag;
+    changes++;
+    last_value = value;
+    return 0;
+}
+
+/* Polls the slave for 4 registers starting at 0 and returns the response length. */
+static uint16_t poll_slave(modbus_slave_t *slave, uint8_t *buf) {
+    uint8_t len = 255;
+    modbus_master_read_registers_rtu(slave->id, 0, 4, buf, &len);
+    modbus_slave_rtu_handle(slave, buf, len);
+    return 3 + 4 * 2 + 2;
+}
+
+class master_change_detect : public ::testing::Test {
+protected:
+    void SetUp() override {
+        modbus_slave_init(&slave);
+        slave.id = 0x01;
+        modbus_register_init(&reg);
+        reg.index = 1;
+        reg.size = 4;
+        reg.data = data;
+        modbus_slave_add_register(&slave, &reg);
+
+        modbus_tag_init(&tags[0]);
+        tags[0].offset = 0;
+        tags[0].type = MODBUS_TAG_INT16;
+        modbus_tag_init(&tags[1]);
+        tags[1].offset = 2;
+        tags[1].type = MODBUS_TAG_UINT32;
+        tags[1].deadband_type = MODBUS_DEADBAND_ABSOLUTE;
+        tags[1].deadband = 10;
+
+        modbus_change_detector_init(&det);
+        det.device_id = 0x01;
+        det.addr = 0;
+        det.quan = 4;
+        det.image = image;
+        det.tags = tags;
+        det.tag_len = 2;
+        det.on_change = on_tag_change;
+        changes = 0;
+    }
+
+    modbus_slave_t slave{};
+    modbus_register_t reg{};
+    uint8_t data[8] = {0xFF, 0xFE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64};
+    uint8_t image[8] = {0};
+    modbus_tag_t tags[2]{};
+    modbus_change_detector_t det{};
+    uint8_t buf[256] = {0};
+};
+
+TEST_F(master_change_detect, first_poll_reports_all) {
+    uint16_t len = poll_slave(&slave, buf);
+    EXPECT_EQ(2, modbus_master_detect_changes(&det, buf, len));
+    EXPECT_EQ(2, changes);
+    EXPECT_EQ(-2.0, tags[0].value);
+    EXPECT_EQ(100.0, tags[1].value);
+}
+
+TEST_F(master_change_detect, unchanged_and_deadband) {
+    uint16_t len = poll_slave(&slave, buf);
+    modbus_master_detect_changes(&det, buf, len);
+
+    len = poll_slave(&slave, buf);
+    EXPECT_EQ(0, modbus_master_detect_changes(&det, buf, len));
+
+    /* Inside the deadband of 10 */
+    data[7] = 0x6A;
+    len = poll_slave(&slave, buf);
+    EXPECT_EQ(0, modbus_master_detect_changes(&det, buf, len));
+
+    /* Out of the deadband relative to the last reported 100 */
+    data[7] = 0x6F;
+    len = poll_slave(&slave, buf);
+    EXPECT_EQ(1, modbus_master_detect_changes(&det, buf, len));
+    EXPECT_EQ(111.0, last_value);
+    EXPECT_EQ(111.0, tags[1].value);
+}
+
+TEST_F(master_change_detect, percent_deadband) {
+    tags[1].deadband_type = MODBUS_DEADBAND_PERCENT;
+    tags[1].deadband = 5;
+    uint16_t len = poll_slave(&slave, buf);
+    modbus_master_detect_changes(&det, buf, len);
+
+    data[7] = 0x69; /* 105, on the 5% boundary */
+    len = poll_slave(&slave, buf);
+    EXPECT_EQ(0, modbus_master_detect_changes(&det, buf, len));
+
+    data[7] = 0x6A; /* 106 */
+    len = poll_slave(&slave, buf);
+    EXPECT_EQ(1, modbus_master_detect_changes(&det, buf, len));
+}
+
+TEST_F(master_change_detect, integrity_interval) {
+    det.integrity_interval = 3;
+    uint16_t len = poll_slave(&slave, buf);
+    EXPECT_EQ(2, modbus_master_detect_changes(&det, buf, len));
+    EXPECT_EQ(0, modbus_master_detect_changes(&det, buf, len));
+    EXPECT_EQ(0, modbus_master_detect_changes(&det, buf, len));
+    EXPECT_EQ(2, modbus_master_detect_changes(&det, buf, len));
+}
+
+TEST_F(master_change_detect, invalid_response) {
+    uint16_t len = poll_slave(&slave, buf);
+    buf[len - 1] ^= 0xFF;
+    EXPECT_EQ(-2, modbus_master_detect_changes(&det, buf, len));
+    buf[len - 1] ^= 0xFF;
+    det.device_id = 0x02;
+    EXPECT_EQ(-1, modbus_master_detect_changes(&det, buf, len));
+    EXPECT_EQ(0, changes);
+}
+
+TEST_F(master_change_detect, float_nan) {
+    tags[1].type = MODBUS_TAG_FLOAT32;
+    tags[1].deadband_type = MODBUS_DEADBAND_ABSOLUTE;
+    tags[1].deadband = 10;
+    /* 1.0f */
+    data[4] = 0x3F; data[5] = 0x80; data[6] = 0x00; data[7] = 0x00;
+    uint16_t len = poll_slave(&slave, buf);
+    modbus_master_detect_changes(&det, buf, len);
+    EXPECT_EQ(1.0, tags[1].value);
+
+    /* Quiet NaN, e.g. a sensor fault */
+    data[4] = 0x7F; data[5] = 0xC0;
+    len = poll_slave(&slave, buf);
+    EXPECT_EQ(1, modbus_master_detect_changes(&det, buf, len));
+    EXPECT_TRUE(std::isnan(tags[1].value));
+
+    /* Another NaN payload is no change */
+    data[7] = 0x01;
+    len = poll_slave(&slave, buf);
+    EXPECT_EQ(0, modbus_master_detect_changes(&det, buf, len));
+
+    /* Leaving NaN is reported as well */
+    data[4] = 0x3F; data[5] = 0x80; data[7] = 0x00;
+    len = poll_slave(&slave, buf);
+    EXPECT_EQ(1, modbus_master_detect_changes(&det, buf, len));
+    EXPECT_EQ(1.0, tags[1].value);
+}
@@ -0,0 +1,54 @@
+#include "modbus.h"
+
+#include "gtest/gtest.h"
+
+TEST(master_timeout, rtt_estimator) {
+    modbus_master_device_t dev;
+    modbus_master_device_init(&dev);
+    EXPECT_EQ(dev.max_rto, dev.rto);
+
+    /* SRTT = 100, RTTVAR = 50 */
+    EXPECT_EQ(300u, modbus_master_device_on_response(&dev, 100));
+
+    int i;
+    for (i = 0; i < 64; i++) {
+        modbus_master_device_on_response(&dev, 100);
+    }
+    /* Converges to SRTT plus the residue of the integer RTTVAR decay */
+    EXPECT_EQ(100u, dev.srtt >> 3);
+    EXPECT_GE(104u, dev.rto);
+
+    modbus_master_device_on_response(&dev, 10);
+    modbus_master_device_on_response(&dev, 400);
+    EXPECT_EQ(10u, dev.rtt_min);
+    EXPECT_EQ(400u, dev.rtt_max);
+    EXPECT_EQ(400u, dev.rtt_last);
+    EXPECT_EQ(67u, dev.responses);
+    EXPECT_GE(dev.max_rto, dev.rto);
+    EXPECT_LT(104u, dev.rto);
+}
+
+TEST(master_timeout, backoff_and_demotion) {
+    modbus_master_device_t dev;
+    modbus_master_device_init(&dev);
+    dev.max_rto = 500;
+    dev.demoted_interval = 1000;
+    modbus_master_device_on_response(&dev, 50);
+    EXPECT_EQ(150u, dev.rto);
+
+    EXPECT_EQ(300u, modbus_master_device_on_timeout(&dev, 0));
+    EXPECT_EQ(1, modbus_master_device_ready(&dev, 0));
+    EXPECT_EQ(500u, modbus_master_device_on_timeout(&dev, 0));
+    EXPECT_EQ(500u, modbus_master_device_on_timeout(&dev, 0xFFFFFF00u));
+    EXPECT_EQ(MODBUS_DEVICE_DEMOTED, dev.state);
+    EXPECT_EQ(3u, dev.timeouts);
+
+    /* Due again after the demoted interval, across the tick wrap-around */
+    EXPECT_EQ(0, modbus_master_device_ready(&dev, 0xFFFFFFFFu));
+    EXPECT_EQ(1, modbus_master_device_ready(&dev, 0x000002E8u));
+
+    modbus_master_device_on_response(&dev, 50);
+    EXPECT_EQ(MODBUS_DEVICE_HEALTHY, dev.state);
+    EXPECT_EQ(0, dev.failures);
+    EXPECT_EQ(1, modbus_master_device_ready(&dev, 0));
+}
@@ -0,0 +1,226 @@
+#include "modbus_shm.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "test_helpers.h"
+
+class shm : public ::testing::Test {
+protected:
+    void SetUp() override {
+        name = "/modbus_test_" + std::to_string(getpid());
+        ASSERT_EQ(0, modbus_shm_create(&producer, name.c_str(), 6, 2));
+        ASSERT_EQ(0, modbus_shm_open(&server, name.c_str()));
+    }
+
+    void TearDown() override {
+        modbus_shm_close(&server);
+        modbus_shm_close(&producer);
+        modbus_shm_unlink(name.c_str());
+    }
+
+    std::string name;
+    modbus_shm_t producer{};
+    modbus_shm_t server{};
+};
+
+TEST_F(shm, layout) {
+    EXPECT_EQ((uint32_t) MODBUS_SHM_MAGIC, server.header->magic);
+    EXPECT_EQ(MODBUS_SHM_VERSION, server.header->version);
+    EXPECT_EQ(6, server.header->reg_count);
+    EXPECT_EQ(3, server.header->block_count);
+    EXPECT_EQ(0, server.header->block_stride % 4);
+}
+
+TEST_F(shm, read_write) {
+    const uint8_t in[6] = {0x00, 0x01, 0x00, 0x02, 0x00, 0x03};
+    uint8_t out[6] = {0x00};
+    ASSERT_EQ(0, modbus_shm_write(&producer, 1, in, 3));
+    ASSERT_EQ(0, modbus_shm_read(&server, 1, out, 3));
+    EXPECT_EQ(0, memcmp(in, out, 6));
+    EXPECT_GT(0, modbus_shm_write(&producer, 5, in, 2));
+}
+
+TEST_F(shm, slave_register_map) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    modbus_register_t regs[3];
+    ASSERT_EQ(0, modbus_shm_register_map(&server, &slave, regs, 1));
+
+    /* FC03 reads what the producer wrote */
+    const uint8_t in[4] = {0x12, 0x34, 0x56, 0x78};
+    modbus_shm_write(&producer, 2, in, 2);
+    uint8_t buf[256] = {0x00};
+    uint8_t len = 255;
+    modbus_master_read_registers_rtu(0x01, 2, 2, buf, &len);
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf, len));
+    EXPECT_EQ(4, buf[2]);
+    EXPECT_EQ(0, memcmp(in, &buf[3], 4));
+
+    /* FC10 writes are visible to the producer */
+    const uint8_t regs_in[4] = {0xAA, 0xBB, 0xCC, 0xDD};
+    len = 255;
+    modbus_master_write_registers_rtu(0x01, 0, 2, (uint8_t *) regs_in, buf, &len);
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf, len));
+    uint8_t out[4] = {0x00};
+    ASSERT_EQ(0, modbus_shm_read(&producer, 0, out, 2));
+    EXPECT_EQ(0, memcmp(regs_in, out, 4));
+}
+
+TEST_F(shm, slave_partial_blocks) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    modbus_register_t regs[3];
+    ASSERT_EQ(0, modbus_shm_register_map(&server, &slave, regs, 1));
+
+    const uint8_t in[6] = {0x00, 0x01, 0x00, 0x02, 0x00, 0x03};
+    modbus_shm_write(&producer, 0, in, 3);
+
+    /* Starts inside block 0 and ends inside block 1 */
+    uint8_t buf[256] = {0x00};
+    uint8_t len = 255;
+    modbus_master_read_registers_rtu(0x01, 1, 2, buf, &len);
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf, len));
+    EXPECT_EQ(4, buf[2]);
+    EXPECT_EQ(0, memcmp(&in[2], &buf[3], 4));
+
+    /* A single register in the middle of the image */
+    const uint8_t reg_in[2] = {0xBE, 0xEF};
+    len = 255;
+    modbus_master_write_registers_rtu(0x01, 3, 1, (uint8_t *) reg_in, buf, &len);
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf, len));
+    uint8_t out[6] = {0x00};
+    ASSERT_EQ(0, modbus_shm_read(&producer, 2, out, 3));
+    EXPECT_EQ(0, memcmp(&in[4], out, 2));
+    EXPECT_EQ(0, memcmp(reg_in, &out[2], 2));
+    EXPECT_EQ(0, out[4]);
+
+    /* Past the end of the image */
+    len = 255;
+    modbus_master_read_registers_rtu(0x01, 5, 2, buf, &len);
+    EXPECT_EQ(0x03, modbus_slave_rtu_handle(&slave, buf, len));
+}
+
+TEST_F(shm, slave_locked_block) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    modbus_register_t regs[3];
+    ASSERT_EQ(0, modbus_shm_register_map(&server, &slave, regs, 1));
+
+    /* A writer that never finishes keeps the block unreadable */
+    uint32_t *seq = (uint32_t *) (void *) producer.blocks;
+    *seq = 1;
+    uint8_t buf[256] = {0x00};
+    uint8_t len = 255;
+    modbus_master_read_registers_rtu(0x01, 0, 1, buf, &len);
+    EXPECT_EQ(0x04, modbus_slave_rtu_handle(&slave, buf, len));
+    EXPECT_EQ(0x83, buf[1]);
+    *seq = 2;
+}
+
+TEST_F(shm, open_rejects_bad_layouts) {
+    modbus_shm_t other{};
+    modbus_shm_header_t good = *producer.header;
+
+    producer.header->block_size = 0;
+    EXPECT_GT(0, modbus_shm_open(&other, name.c_str()));
+    *producer.header = good;
+
+    producer.header->block_stride = 4;
+    EXPECT_GT(0, modbus_shm_open(&other, name.c_str()));
+    *producer.header = good;
+
+    producer.header->block_stride = (uint16_t) (good.block_stride + 2);
+    EXPECT_GT(0, modbus_shm_open(&other, name.c_str()));
+    *producer.header = good;
+
+    producer.header->block_count = 2;
+    EXPECT_GT(0, modbus_shm_open(&other, name.c_str()));
+    *producer.header = good;
+
+    ASSERT_EQ(0, modbus_shm_open(&other, name.c_str()));
+    modbus_shm_close(&other);
+}
+
+TEST_F(shm, create_rejects_large_blocks) {
+    std::string big = name + "_big";
+    modbus_shm_t other{};
+    /* The stride of 40000 registers does not fit into 16 bits */
+    EXPECT_GT(0, modbus_shm_create(&other, big.c_str(), 40000, 40000));
+    EXPECT_GT(0, modbus_shm_create(&other, big.c_str(), 40000, 32765));
+
+    ASSERT_EQ(0, modbus_shm_create(&other, big.c_str(), 40000, 32764));
+    EXPECT_EQ(65532, other.header->block_stride);
+    modbus_shm_t reopened{};
+    ASSERT_EQ(0, modbus_shm_open(&reopened, big.c_str()));
+    modbus_shm_close(&reopened);
+    modbus_shm_close(&other);
+    modbus_shm_unlink(big.c_str());
+}
+
+TEST_F(shm, writers_exclude_each_other) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    modbus_register_t regs[3];
+    ASSERT_EQ(0, modbus_shm_register_map(&server, &slave, regs, 1));
+
+    /* Another writer holds block 0 */
+    uint32_t *seq = (uint32_t *) (void *) producer.blocks;
+    *seq = 1;
+    const uint8_t in[4] = {0xAA, 0xBB, 0xCC, 0xDD};
+    EXPECT_GT(0, modbus_shm_write(&producer, 0, in, 2));
+    uint8_t buf[256] = {0x00};
+    uint8_t len = 255;
+    modbus_master_write_registers_rtu(0x01, 0, 2, (uint8_t *) in, buf, &len);
+    EXPECT_EQ(0x04, modbus_slave_rtu_handle(&slave, buf, len));
+    EXPECT_EQ(1u, *seq);
+    EXPECT_EQ(0, producer.blocks[sizeof(uint32_t)]);
+
+    /* Released, the next writer moves the counter by two */
+    *seq = 2;
+    ASSERT_EQ(0, modbus_shm_write(&producer, 0, in, 2));
+    EXPECT_EQ(4u, *seq);
+}
+
+TEST_F(shm, concurrent_writers_no_torn_reads) {
+    /* Large blocks keep the writers inside the block long enough to overlap */
+    std::string big = name + "_race";
+    modbus_shm_t image{};
+    ASSERT_EQ(0, modbus_shm_create(&image, big.c_str(), 4096, 4096));
+    std::atomic<bool> stop{false};
+    auto writer = [&](uint8_t fill) {
+        std::vector<uint8_t> in(8192, fill);
+        while (!stop.load()) {
+            modbus_shm_write(&image, 0, in.data(), 4096);
+        }
+    };
+    std::thread a(writer, 0x11);
+    std::thread b(writer, 0x22);
+
+    int torn = 0;
+    std::vector<uint8_t> out(8192);
+    for (int i = 0; i < 20000; i++) {
+        if (modbus_shm_read(&image, 0, out.data(), 4096) != 0) continue;
+        if (out.front() != out.back()) torn++;
+    }
+    stop.store(true);
+    a.join();
+    b.join();
+    modbus_shm_close(&image);
+    modbus_shm_unlink(big.c_str());
+    EXPECT_EQ(0, torn);
+}
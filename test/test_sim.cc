@@ -0,0 +1,161 @@
+#include "modbus_sim.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+class sim : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (uint16_t i = 0; i < 40; i++) {
+            modbus_uint16_to_reg(i, &image[i * 2]);
+        }
+        waves[0] = {38, MODBUS_SIM_WAVE_RAMP, 100, 0, 1000};
+        waves[1] = {39, MODBUS_SIM_WAVE_SQUARE, 10, 1, 2};
+        tmpl.image = image;
+        tmpl.reg_count = 40;
+        tmpl.waves = waves;
+        tmpl.wave_len = 2;
+        devices.resize(10000);
+        ASSERT_EQ(0, modbus_sim_init(&s, &tmpl, devices.data(), (uint16_t) devices.size(), pages, 4));
+    }
+
+    uint8_t image[80]{};
+    modbus_sim_wave_t waves[2]{};
+    modbus_sim_template_t tmpl{};
+    std::vector<modbus_sim_device_t> devices;
+    modbus_sim_page_t pages[4]{};
+    modbus_sim_t s{};
+};
+
+TEST_F(sim, copy_on_write) {
+    uint8_t regs[8] = {0};
+    const uint8_t in[4] = {0xAB, 0xCD, 0x12, 0x34};
+
+    /* Crosses the page boundary at 16 */
+    ASSERT_EQ(0, modbus_sim_write(&s, 9999, 15, 2, in));
+    EXPECT_EQ(2, s.free_len);
+
+    ASSERT_EQ(0, modbus_sim_read(&s, 9999, 14, 4, regs));
+    EXPECT_EQ(14, modbus_reg_to_uint16(&regs[0]));
+    EXPECT_EQ(0, memcmp(in, &regs[2], 4));
+    EXPECT_EQ(17, modbus_reg_to_uint16(&regs[6]));
+
+    /* Other devices still see the template */
+    ASSERT_EQ(0, modbus_sim_read(&s, 0, 15, 2, regs));
+    EXPECT_EQ(15, modbus_reg_to_uint16(&regs[0]));
+
+    ASSERT_EQ(0, modbus_sim_reset(&s, 9999));
+    EXPECT_EQ(4, s.free_len);
+    ASSERT_EQ(0, modbus_sim_read(&s, 9999, 15, 1, regs));
+    EXPECT_EQ(15, modbus_reg_to_uint16(&regs[0]));
+}
+
+TEST_F(sim, pool_exhausted) {
+    const uint8_t in[2] = {0x00, 0x01};
+    ASSERT_EQ(0, modbus_sim_write(&s, 1, 0, 1, in));
+    ASSERT_EQ(0, modbus_sim_write(&s, 2, 0, 1, in));
+    ASSERT_EQ(0, modbus_sim_write(&s, 3, 0, 1, in));
+    ASSERT_EQ(0, modbus_sim_write(&s, 4, 0, 1, in));
+    EXPECT_EQ(-2, modbus_sim_write(&s, 5, 0, 1, in));
+    /* Writing an already copied page needs no new page */
+    EXPECT_EQ(0, modbus_sim_write(&s, 4, 1, 1, in));
+    EXPECT_EQ(-1, modbus_sim_write(&s, 4, 39, 2, in));
+}
+
+TEST_F(sim, waveforms) {
+    uint8_t regs[4] = {0};
+    s.now = 50;
+    ASSERT_EQ(0, modbus_sim_read(&s, 0, 38, 2, regs));
+    EXPECT_EQ(500, modbus_reg_to_uint16(&regs[0]));
+    EXPECT_EQ(1, modbus_reg_to_uint16(&regs[2]));
+    s.now = 55;
+    ASSERT_EQ(0, modbus_sim_read(&s, 0, 38, 2, regs));
+    EXPECT_EQ(550, modbus_reg_to_uint16(&regs[0]));
+    EXPECT_EQ(2, modbus_reg_to_uint16(&regs[2]));
+}
+
+TEST_F(sim, triangle_odd_period) {
+    const modbus_sim_wave_t triangle[1] = {{0, MODBUS_SIM_WAVE_TRIANGLE, 5, 0, 1000}};
+    tmpl.waves = triangle;
+    tmpl.wave_len = 1;
+    /* Device 0 has no phase offset */
+    const uint16_t expected[5] = {0, 500, 1000, 666, 333};
+    uint8_t regs[2] = {0};
+    for (uint32_t t = 0; t < 5; t++) {
+        s.now = t;
+        ASSERT_EQ(0, modbus_sim_read(&s, 0, 0, 1, regs));
+        EXPECT_EQ(expected[t], modbus_reg_to_uint16(regs));
+    }
+}
+
+TEST_F(sim, rtu_handle) {
+    uint8_t buf[256] = {0};
+    uint8_t len = 255;
+    uint8_t regs[2] = {0x11, 0x22};
+    modbus_master_write_registers_rtu(0x07, 3, 1, regs, buf, &len);
+    ASSERT_EQ(0, modbus_sim_rtu_handle(&s, 42, buf, len));
+    EXPECT_EQ(0x07, buf[0]);
+    EXPECT_EQ(0x10, buf[1]);
+
+    len = 255;
+    modbus_master_read_registers_rtu(0x07, 2, 2, buf, &len);
+    ASSERT_EQ(0, modbus_sim_rtu_handle(&s, 42, buf, len));
+    EXPECT_EQ(0x03, buf[1]);
+    EXPECT_EQ(4, buf[2]);
+    EXPECT_EQ(2, modbus_reg_to_uint16(&buf[3]));
+    EXPECT_EQ(0x1122, modbus_reg_to_uint16(&buf[5]));
+
+    /* Ends past the template */
+    len = 255;
+    modbus_master_read_registers_rtu(0x07, 39, 2, buf, &len);
+    EXPECT_EQ(3, modbus_sim_rtu_handle(&s, 42, buf, len));
+    EXPECT_EQ(0x83, buf[1]);
+
+    len = 255;
+    modbus_master_read_registers_rtu(0x07, 40, 1, buf, &len);
+    EXPECT_EQ(2, modbus_sim_rtu_handle(&s, 42, buf, len));
+
+    len = 255;
+    modbus_master_read_registers_rtu(0x07, 0, 1, buf, &len);
+    EXPECT_EQ(-1, modbus_sim_rtu_handle(&s, 10000, buf, len));
+}
+
+TEST_F(sim, pdu_handle) {
+    /* Unit ID 3 addresses device base + 2 */
+    uint8_t buf[256] = {0x03, 0x10, 0x00, 0x05, 0x00, 0x01, 0x02, 0xBE, 0xEF};
+    uint16_t reply_len = 0;
+    ASSERT_EQ(0, modbus_sim_pdu_handle(&s, 100, buf, 9, &reply_len));
+    EXPECT_EQ(6, reply_len);
+    uint8_t regs[2] = {0};
+    ASSERT_EQ(0, modbus_sim_read(&s, 102, 5, 1, regs));
+    EXPECT_EQ(0xBEEF, modbus_reg_to_uint16(regs));
+
+    const uint8_t read[6] = {0x03, 0x03, 0x00, 0x04, 0x00, 0x02};
+    memcpy(buf, read, sizeof(read));
+    ASSERT_EQ(0, modbus_sim_pdu_handle(&s, 100, buf, 6, &reply_len));
+    EXPECT_EQ(7, reply_len);
+    EXPECT_EQ(4, modbus_reg_to_uint16(&buf[3]));
+    EXPECT_EQ(0xBEEF, modbus_reg_to_uint16(&buf[5]));
+
+    /* Pool exhausted */
+    const uint8_t in[2] = {0x00, 0x01};
+    for (uint16_t device = 0; s.free_len > 0; device++) {
+        modbus_sim_write(&s, device, 0, 1, in);
+    }
+    const uint8_t write[9] = {0x01, 0x10, 0x00, 0x20, 0x00, 0x01, 0x02, 0x00, 0x01};
+    memcpy(buf, write, sizeof(write));
+    EXPECT_EQ(4, modbus_sim_pdu_handle(&s, 200, buf, 9, &reply_len));
+    EXPECT_EQ(0x90, buf[1]);
+
+    /* Unit IDs outside of the device range */
+    memcpy(buf, read, sizeof(read));
+    buf[0] = 0x00;
+    EXPECT_EQ(-1, modbus_sim_pdu_handle(&s, 0, buf, 6, &reply_len));
+    buf[0] = 0x02;
+    EXPECT_EQ(-1, modbus_sim_pdu_handle(&s, 9999, buf, 6, &reply_len));
+    /* Reserved unit IDs, even with enough devices */
+    buf[0] = 0xF8;
+    EXPECT_EQ(-1, modbus_sim_pdu_handle(&s, 0, buf, 6, &reply_len));
+    EXPECT_EQ(0, reply_len);
+}
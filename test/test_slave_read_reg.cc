@@ -99,3 +99,120 @@ TEST(slave_read_reg, on_read) {
     EXPECT_EQ(2.33f, t2_out);
 }
 
+int read_cb_2(modbus_register_t *reg, const uint8_t *buf) {
+    (void) buf;
+    reg->data[1]++;
+    return 0;
+}
+
+TEST(slave_read_reg, reply_cache) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    modbus_cache_entry_t cache[4] = {};
+    slave.cache = cache;
+    slave.cache_len = 4;
+
+    uint8_t data[4] = {0x00, 0x01, 0x00, 0x02};
+    modbus_register_t reg0;
+    modbus_register_init(&reg0);
+    reg0.index = 1;
+    reg0.size = 1;
+    reg0.data = &data[0];
+    modbus_slave_add_register(&slave, &reg0);
+    modbus_register_t reg1;
+    modbus_register_init(&reg1);
+    reg1.index = 2;
+    reg1.size = 1;
+    reg1.data = &data[2];
+    modbus_slave_add_register(&slave, &reg1);
+
+    uint8_t buf[256] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xC4, 0x0B};
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf, 8));
+    EXPECT_EQ(0x02, buf[6]);
+
+    /* Served from the cache until the application invalidates the range */
+    data[3] = 0x03;
+    uint8_t buf1[256] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xC4, 0x0B};
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf1, 8));
+    EXPECT_EQ(0, memcmp(buf, buf1, 9));
+    modbus_slave_invalidate(&slave, 1, 1);
+    uint8_t buf2[256] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xC4, 0x0B};
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf2, 8));
+    EXPECT_EQ(0x03, buf2[6]);
+
+    /* FC10 invalidates the written range */
+    uint8_t buf3[256] = {0};
+    uint8_t len = 255;
+    uint8_t regs[2] = {0x00, 0x07};
+    modbus_master_write_registers_rtu(0x01, 1, 1, regs, buf3, &len);
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf3, len));
+    uint8_t buf4[256] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xC4, 0x0B};
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf4, 8));
+    EXPECT_EQ(0x07, buf4[6]);
+
+    /* Registers with a read callback are never cached */
+    reg1.on_read = read_cb_2;
+    modbus_slave_invalidate(&slave, 0, 2);
+    uint8_t buf5[256] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xC4, 0x0B};
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf5, 8));
+    EXPECT_EQ(0x08, buf5[6]);
+    uint8_t buf6[256] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x02, 0xC4, 0x0B};
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf6, 8));
+    EXPECT_EQ(0x09, buf6[6]);
+}
+
+TEST(slave_read_reg, quantity_limits) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+
+    uint8_t data[400] = {0x00};
+    modbus_register_t reg;
+    modbus_register_init(&reg);
+    reg.index = 1;
+    reg.size = 200;
+    reg.data = data;
+    modbus_slave_add_register(&slave, &reg);
+
+    /* The whole node would not fit into a reply */
+    uint8_t buf[256] = {0x00};
+    uint8_t len = 255;
+    modbus_master_read_registers_rtu(0x01, 0, 200, buf, &len);
+    EXPECT_EQ(0x03, modbus_slave_rtu_handle(&slave, buf, len));
+    EXPECT_EQ(0x83, buf[1]);
+    EXPECT_EQ(0x03, buf[2]);
+
+    len = 255;
+    modbus_master_read_registers_rtu(0x01, 0, 0, buf, &len);
+    EXPECT_EQ(0x03, modbus_slave_rtu_handle(&slave, buf, len));
+}
+
+TEST(slave_read_reg, reply_cache_largest_reply) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    modbus_cache_entry_t cache[1] = {};
+    slave.cache = cache;
+    slave.cache_len = 1;
+
+    uint8_t data[250] = {0x00};
+    modbus_register_t reg;
+    modbus_register_init(&reg);
+    reg.index = 1;
+    reg.size = 125;
+    reg.data = data;
+    modbus_slave_add_register(&slave, &reg);
+
+    /* 3 Bytes header, 250 Bytes registers and the CRC16 fill the entry exactly */
+    uint8_t buf[256] = {0x00};
+    uint8_t len = 255;
+    modbus_master_read_registers_rtu(0x01, 0, 125, buf, &len);
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf, len));
+    EXPECT_EQ(1, cache[0].valid);
+    EXPECT_EQ(255, cache[0].len);
+    EXPECT_EQ(0, memcmp(buf, cache[0].frame, 255));
+}
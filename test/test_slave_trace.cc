@@ -0,0 +1,97 @@
+#include "modbus.h"
+#include "modbus_trace.h"
+
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "test_helpers.h"
+
+static uint32_t ticks = 0;
+
+uint32_t trace_clock() {
+    return ticks += 10;
+}
+
+TEST(slave_trace, ring_overwrites_oldest) {
+    modbus_trace_event_t events[4];
+    modbus_trace_t trace;
+    ASSERT_GT(0, modbus_trace_init(&trace, events, 3, trace_clock));
+    ASSERT_EQ(0, modbus_trace_init(&trace, events, 4, trace_clock));
+
+    uint16_t i;
+    for (i = 0; i < 6; i++) {
+        modbus_trace_record(&trace, MODBUS_TRACE_FRAME_BEGIN, i);
+    }
+
+    /* The slot after the newest event may be under construction and is dropped */
+    modbus_trace_event_t out[8];
+    uint32_t len = modbus_trace_dump(&trace, out, 8);
+    ASSERT_EQ(3, len);
+    EXPECT_EQ(3, out[0].arg);
+    EXPECT_EQ(5, out[2].arg);
+    EXPECT_EQ(out[1].time + 10, out[2].time);
+
+    len = modbus_trace_dump(&trace, out, 2);
+    ASSERT_EQ(2, len);
+    EXPECT_EQ(4, out[0].arg);
+}
+
+TEST(slave_trace, chrome_json) {
+    modbus_trace_event_t events[3] = {
+            {0xFFFFFFF0u, MODBUS_TRACE_FRAME_BEGIN, 8},
+            {0x00000010u, MODBUS_TRACE_CRC_CHECKED, 3},
+            {0x00000030u, MODBUS_TRACE_FRAME_END, 0},
+    };
+    char text[1024] = {0};
+    FILE *fp = tmpfile();
+    ASSERT_NE(nullptr, fp);
+    ASSERT_EQ(0, modbus_trace_write_chrome_json(fp, events, 3, 1.0, 1));
+    rewind(fp);
+    size_t len = fread(text, 1, sizeof(text) - 1, fp);
+    fclose(fp);
+    ASSERT_LT(0u, len);
+
+    std::string json(text);
+    EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+    EXPECT_NE(std::string::npos, json.find("\"name\":\"frame\",\"ph\":\"B\",\"ts\":0.000"));
+    EXPECT_NE(std::string::npos, json.find("\"name\":\"crc\",\"ph\":\"i\",\"ts\":32.000"));
+    EXPECT_NE(std::string::npos, json.find("\"name\":\"frame\",\"ph\":\"E\",\"ts\":64.000"));
+}
+
+TEST(slave_trace, slave_hooks) {
+    modbus_trace_event_t events[64];
+    modbus_trace_t trace;
+    modbus_trace_init(&trace, events, 64, trace_clock);
+
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    slave.trace = &trace;
+
+    uint16_t data = 0;
+    modbus_register_t reg;
+    modbus_register_init(&reg);
+    reg.index = 1;
+    reg.size = 1;
+    reg.data = (uint8_t *) &data;
+    reg.on_read = [](modbus_register_t *, const uint8_t *) { return 0; };
+    modbus_slave_add_register(&slave, &reg);
+
+    uint8_t buf[256] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x01, 0x84, 0x0A};
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf, 8));
+
+    const uint16_t expected[] = {
+            MODBUS_TRACE_FRAME_BEGIN, MODBUS_TRACE_CRC_CHECKED, MODBUS_TRACE_LOOKUP_DONE,
+            MODBUS_TRACE_REG_CB_BEGIN, MODBUS_TRACE_REG_CB_END,
+            MODBUS_TRACE_REPLY_BEGIN, MODBUS_TRACE_REPLY_END, MODBUS_TRACE_FRAME_END,
+    };
+    modbus_trace_event_t out[64];
+    uint32_t len = modbus_trace_dump(&trace, out, 64);
+    ASSERT_EQ(sizeof(expected) / sizeof(expected[0]), len);
+    for (uint32_t i = 0; i < len; i++) {
+        EXPECT_EQ(expected[i], out[i].type);
+    }
+}
@@ -0,0 +1,161 @@
+#include "modbus_udp.h"
+
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+class slave_udp : public ::testing::Test {
+protected:
+    void SetUp() override {
+        modbus_slave_init(&slave);
+        slave.id = 0x01;
+        modbus_register_init(&reg);
+        reg.index = 1;
+        reg.size = 2;
+        reg.data = data;
+        modbus_slave_add_register(&slave, &reg);
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        server = socket(AF_INET, SOCK_DGRAM, 0);
+        ASSERT_EQ(0, bind(server, (sockaddr *) &addr, sizeof(addr)));
+        socklen_t len = sizeof(server_addr);
+        getsockname(server, (sockaddr *) &server_addr, &len);
+        client = socket(AF_INET, SOCK_DGRAM, 0);
+        ASSERT_EQ(0, connect(client, (sockaddr *) &server_addr, sizeof(server_addr)));
+
+        rx.resize(MODBUS_UDP_BATCH * MODBUS_UDP_ADU_SIZE);
+        ASSERT_EQ(0, modbus_udp_init(&udp, server, &slave, rx.data(), rx.size()));
+    }
+
+    void TearDown() override {
+        close(client);
+        close(server);
+    }
+
+    /* Sends an FC03 request for both registers with the given transaction and unit ID. */
+    void send_read(uint8_t tid, uint8_t unit) {
+        const uint8_t req[12] = {0x00, tid, 0x00, 0x00, 0x00, 0x06, unit, 0x03, 0x00, 0x00, 0x00, 0x02};
+        ASSERT_EQ(12, send(client, req, sizeof(req), 0));
+    }
+
+    modbus_slave_t slave{};
+    modbus_register_t reg{};
+    uint8_t data[4] = {0x12, 0x34, 0x56, 0x78};
+    int server = -1, client = -1;
+    sockaddr_in server_addr{};
+    std::vector<uint8_t> rx;
+    modbus_udp_t udp{};
+};
+
+TEST_F(slave_udp, batch) {
+    send_read(1, 0x01);
+    send_read(2, 0x02); /* Other unit, dropped */
+    send_read(3, 0x01);
+    const uint8_t write[17] = {0x00, 0x04, 0x00, 0x00, 0x00, 0x0B, 0x01, 0x10,
+                               0x00, 0x00, 0x00, 0x02, 0x04, 0xAA, 0xBB, 0xCC, 0xDD};
+    ASSERT_EQ(17, send(client, write, sizeof(write), 0));
+
+    int handled = 0;
+    while (handled < 3) {
+        int rc = modbus_udp_poll(&udp);
+        ASSERT_LE(0, rc);
+        handled += rc;
+    }
+    EXPECT_GE(3u, udp.recv_calls);
+    EXPECT_EQ(udp.recv_calls, udp.send_calls);
+
+    uint8_t buf[300];
+    ASSERT_EQ(13, recv(client, buf, sizeof(buf), 0));
+    const uint8_t reply[13] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x07, 0x01, 0x03, 0x04, 0x12, 0x34, 0x56, 0x78};
+    EXPECT_EQ(0, memcmp(reply, buf, 13));
+    ASSERT_EQ(13, recv(client, buf, sizeof(buf), 0));
+    EXPECT_EQ(0x03, buf[1]);
+    ASSERT_EQ(12, recv(client, buf, sizeof(buf), 0));
+    EXPECT_EQ(0x04, buf[1]);
+    EXPECT_EQ(0x06, buf[5]);
+    EXPECT_EQ(0x10, buf[7]);
+    EXPECT_EQ(0xAA, data[0]);
+    EXPECT_EQ(0xDD, data[3]);
+}
+
+TEST_F(slave_udp, poll_one) {
+    send_read(7, 0x01);
+    ASSERT_EQ(1, modbus_udp_poll_one(&udp));
+    uint8_t buf[300];
+    ASSERT_EQ(13, recv(client, buf, sizeof(buf), 0));
+    EXPECT_EQ(0x07, buf[1]);
+    EXPECT_EQ(0x04, buf[8]);
+    EXPECT_EQ(1u, udp.send_calls);
+}
+
+TEST_F(slave_udp, exception_reply) {
+    const uint8_t req[12] = {0x00, 0x09, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x05, 0x00, 0x01};
+    ASSERT_EQ(12, send(client, req, sizeof(req), 0));
+    ASSERT_EQ(1, modbus_udp_poll(&udp));
+    uint8_t buf[300];
+    ASSERT_EQ(9, recv(client, buf, sizeof(buf), 0));
+    EXPECT_EQ(0x03, buf[5]);
+    EXPECT_EQ(0x83, buf[7]);
+    EXPECT_EQ(0x02, buf[8]);
+}
+
+TEST_F(slave_udp, oversized_read) {
+    uint8_t data_big[400] = {0x00};
+    modbus_register_t big{};
+    modbus_register_init(&big);
+    big.index = 3;
+    big.size = 200;
+    big.data = data_big;
+    modbus_slave_add_register(&slave, &big);
+
+    /* 200 registers from index 3 would not fit into the reply slot */
+    const uint8_t req[12] = {0x00, 0x0A, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x02, 0x00, 0xC8};
+    ASSERT_EQ(12, send(client, req, sizeof(req), 0));
+    ASSERT_EQ(1, modbus_udp_poll(&udp));
+    uint8_t buf[300];
+    ASSERT_EQ(9, recv(client, buf, sizeof(buf), 0));
+    EXPECT_EQ(0x83, buf[7]);
+    EXPECT_EQ(0x03, buf[8]);
+}
+
+TEST_F(slave_udp, simulated_devices) {
+    uint8_t image[8] = {0x00, 0x0A, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x0D};
+    modbus_sim_template_t tmpl{image, 4, nullptr, 0};
+    modbus_sim_device_t devices[300];
+    modbus_sim_page_t pages[2];
+    modbus_sim_t sim{};
+    ASSERT_EQ(0, modbus_sim_init(&sim, &tmpl, devices, 300, pages, 2));
+    ASSERT_EQ(0, modbus_udp_init_sim(&udp, server, &sim, 247, rx.data(), rx.size()));
+
+    /* Unit ID 2 is device 248 */
+    const uint8_t write[15] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x09, 0x02, 0x10,
+                               0x00, 0x01, 0x00, 0x01, 0x02, 0x12, 0x34};
+    ASSERT_EQ(15, send(client, write, sizeof(write), 0));
+    send_read(2, 0x02);
+    send_read(3, 0x01);
+    int handled = 0;
+    while (handled < 3) {
+        int rc = modbus_udp_poll(&udp);
+        ASSERT_LE(0, rc);
+        handled += rc;
+    }
+
+    uint8_t buf[300];
+    ASSERT_EQ(12, recv(client, buf, sizeof(buf), 0));
+    EXPECT_EQ(0x10, buf[7]);
+    const uint8_t reply[13] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0x02, 0x03, 0x04, 0x00, 0x0A, 0x12, 0x34};
+    ASSERT_EQ(13, recv(client, buf, sizeof(buf), 0));
+    EXPECT_EQ(0, memcmp(reply, buf, 13));
+    ASSERT_EQ(13, recv(client, buf, sizeof(buf), 0));
+    EXPECT_EQ(0x0B, buf[12]);
+
+    uint8_t regs[2] = {0};
+    ASSERT_EQ(0, modbus_sim_read(&sim, 248, 1, 1, regs));
+    EXPECT_EQ(0x1234, modbus_reg_to_uint16(regs));
+}
@@ -68,4 +68,167 @@ TEST(slave_write, write_multi_registers) {
     };
     modbus_slave_rtu_handle(&slave, buf_f32, 13);
     ASSERT_EQ(3.14f, data_f32);
-}
\ No newline at end of file
+}
+
+static int batch_calls = 0;
+static uint16_t batch_addr = 0, batch_quan = 0;
+
+int slave_on_write_batch(modbus_slave_t *slave, uint16_t addr, uint16_t quan) {
+    (void) slave;
+    batch_calls++;
+    batch_addr = addr;
+    batch_quan = quan;
+    return 0;
+}
+
+TEST(slave_write, batch_and_dirty_map) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    slave.on_write_batch = slave_on_write_batch;
+    uint8_t dirty[2] = {0x00};
+    slave.dirty_map = dirty;
+    slave.dirty_map_size = sizeof(dirty);
+
+    uint32_t data_u32 = 0;
+    modbus_register_t reg_u32;
+    modbus_register_init(&reg_u32);
+    reg_u32.index = 1;
+    reg_u32.size = 2;
+    reg_u32.data = (uint8_t *) &data_u32;
+    modbus_slave_add_register(&slave, &reg_u32);
+
+    float data_f32 = 0.0f;
+    modbus_register_t reg_f32;
+    modbus_register_init(&reg_f32);
+    reg_f32.index = 3;
+    reg_f32.size = 2;
+    reg_f32.data = (uint8_t *) &data_f32;
+    modbus_slave_add_register(&slave, &reg_f32);
+
+    uint16_t addr, quan;
+    ASSERT_EQ(0, modbus_slave_consume_dirty(&slave, &addr, &quan));
+
+    uint8_t buf_f32[256] = {
+            0x01, 0x10,
+            0x00, 0x02, 0x00, 0x02,
+            0x04, 0xC3, 0xF5, 0x48, 0x40,
+            0x69, 0xF0
+    };
+    batch_calls = 0;
+    ASSERT_EQ(0, modbus_slave_rtu_handle(&slave, buf_f32, 13));
+    ASSERT_EQ(1, batch_calls);
+    ASSERT_EQ(2, batch_addr);
+    ASSERT_EQ(2, batch_quan);
+    ASSERT_EQ(0x0C, dirty[0]);
+
+    ASSERT_EQ(1, modbus_slave_consume_dirty(&slave, &addr, &quan));
+    ASSERT_EQ(2, addr);
+    ASSERT_EQ(2, quan);
+    ASSERT_EQ(0, modbus_slave_consume_dirty(&slave, &addr, &quan));
+}
+
+TEST(slave_write, consume_dirty_runs) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    /* Registers 6..9 and 12 are dirty */
+    uint8_t dirty[3] = {0xC0, 0x13, 0x00};
+    slave.dirty_map = dirty;
+    slave.dirty_map_size = sizeof(dirty);
+
+    uint16_t addr, quan;
+    ASSERT_EQ(1, modbus_slave_consume_dirty(&slave, &addr, &quan));
+    ASSERT_EQ(6, addr);
+    ASSERT_EQ(4, quan);
+    ASSERT_EQ(1, modbus_slave_consume_dirty(&slave, &addr, &quan));
+    ASSERT_EQ(12, addr);
+    ASSERT_EQ(1, quan);
+    ASSERT_EQ(0, modbus_slave_consume_dirty(&slave, &addr, &quan));
+    ASSERT_EQ(0, dirty[0] | dirty[1] | dirty[2]);
+}
+
+TEST(slave_write, quantity_limits) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+
+    uint8_t data[400] = {0x00};
+    modbus_register_t reg;
+    modbus_register_init(&reg);
+    reg.index = 1;
+    reg.size = 124;
+    reg.data = data;
+    modbus_slave_add_register(&slave, &reg);
+
+    /* 124 registers, one more than a request may carry */
+    uint8_t buf[300] = {0x01, 0x10, 0x00, 0x00, 0x00, 0x7C, 0xF8};
+    uint16_t crc16 = modbus_crc16(buf, 7 + 248);
+    memcpy(&buf[7 + 248], &crc16, 2);
+    EXPECT_EQ(0x03, modbus_slave_rtu_handle(&slave, buf, 7 + 248 + 2));
+    EXPECT_EQ(0x90, buf[1]);
+    EXPECT_EQ(0x03, buf[2]);
+
+    /* Byte count does not match the quantity */
+    uint8_t buf1[256] = {0x01, 0x10, 0x00, 0x00, 0x00, 0x02, 0x02, 0x11, 0x22};
+    crc16 = modbus_crc16(buf1, 9);
+    memcpy(&buf1[9], &crc16, 2);
+    EXPECT_EQ(0x03, modbus_slave_rtu_handle(&slave, buf1, 11));
+    EXPECT_EQ(0, data[0]);
+}
+
+int write_cb_fail(modbus_register_t *reg, const uint8_t *buf) {
+    (void) reg;
+    (void) buf;
+    return -1;
+}
+
+TEST(slave_write, validated_before_write) {
+    modbus_slave_t slave;
+    modbus_slave_init(&slave);
+    slave.id = 0x01;
+    slave.on_write = slave_on_reply;
+    slave.on_write_batch = slave_on_write_batch;
+    uint8_t dirty[1] = {0x00};
+    slave.dirty_map = dirty;
+    slave.dirty_map_size = sizeof(dirty);
+
+    uint8_t data[6] = {0x00};
+    modbus_register_t regs[3];
+    for (uint16_t i = 0; i < 3; i++) {
+        modbus_register_init(&regs[i]);
+        regs[i].size = 1;
+        regs[i].data = &data[i * 2];
+    }
+    /* Registers 1, 2 and 4, with a gap at 3 */
+    regs[0].index = 1;
+    regs[1].index = 2;
+    regs[2].index = 4;
+    modbus_slave_add_register(&slave, &regs[0]);
+    modbus_slave_add_register(&slave, &regs[1]);
+    modbus_slave_add_register(&slave, &regs[2]);
+
+    /* The gap is found before anything is written */
+    uint8_t in[8] = {0x11, 0x11, 0x22, 0x22, 0x33, 0x33, 0x44, 0x44};
+    uint8_t buf[256] = {0x00};
+    uint8_t len = 255;
+    batch_calls = 0;
+    modbus_master_write_registers_rtu(0x01, 0, 4, in, buf, &len);
+    EXPECT_EQ(0x03, modbus_slave_rtu_handle(&slave, buf, len));
+    EXPECT_EQ(0, data[0]);
+    EXPECT_EQ(0, dirty[0]);
+    EXPECT_EQ(0, batch_calls);
+
+    /* A failing callback still reports what was written before it */
+    regs[1].on_write = write_cb_fail;
+    len = 255;
+    modbus_master_write_registers_rtu(0x01, 0, 2, in, buf, &len);
+    EXPECT_EQ(0x04, modbus_slave_rtu_handle(&slave, buf, len));
+    EXPECT_EQ(0x11, data[0]);
+    EXPECT_EQ(0, data[2]);
+    EXPECT_EQ(0x01, dirty[0]);
+    ASSERT_EQ(1, batch_calls);
+    EXPECT_EQ(0, batch_addr);
+    EXPECT_EQ(1, batch_quan);
+}